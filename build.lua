@@ -205,6 +205,7 @@ var "tarlz_url" "http://download-mirror.savannah.gnu.org/releases/lzip/tarlz/tar
 local tarlz_sources = F.map(F.prefix("tarlz-$tarlz_version/"), {
     "archive_reader.cc",
     "arg_parser.cc",
+    "catalog.cc",
     "common.cc",
     "common_decode.cc",
     "common_mutex.cc",
@@ -83,17 +83,33 @@ bool Range_decoder::read_block()
   }
 
 
+// Update the CRC with the data from crc_pos to end.
+void LZ_decoder::update_crc( const unsigned end )
+  {
+  crc32.update_buf( crc_, buffer + crc_pos, end - crc_pos );
+  crc_pos = end;
+  }
+
+
+// Write the data from stream_pos to end.
+void LZ_decoder::write_data( const unsigned end )
+  {
+  const int size = end - stream_pos;
+  if( outfd >= 0 && writeblock( outfd, buffer + stream_pos, size ) != size )
+    throw Error( wr_err_msg );
+  stream_pos = end;
+  }
+
+
 void LZ_decoder::flush_data()
   {
   if( pos > stream_pos )
     {
-    const int size = pos - stream_pos;
-    crc32.update_buf( crc_, buffer + stream_pos, size );
-    if( outfd >= 0 && writeblock( outfd, buffer + stream_pos, size ) != size )
-      throw Error( wr_err_msg );
+    update_crc( pos );
+    write_data( pos );
     if( pos >= dictionary_size )
       { partial_data_pos += pos; pos = 0; pos_wrapped = true; }
-    stream_pos = pos;
+    crc_pos = stream_pos = pos;
     }
   }
 
@@ -165,7 +181,8 @@ bool LZ_decoder::check_trailer( const Pretty_print & pp ) const
 /* Return value: 0 = OK, 1 = decoder error, 2 = unexpected EOF,
                  3 = trailer error, 4 = unknown marker found,
                  5 = nonzero first LZMA byte found. */
-int LZ_decoder::decode_member( const Pretty_print & pp )
+template< bool branchless >
+int LZ_decoder::decode_member_( const Pretty_print & pp )
   {
   Bit_model bm_literal[1<<literal_context_bits][0x300];
   Bit_model bm_match[State::states][pos_states];
@@ -188,15 +205,18 @@ int LZ_decoder::decode_member( const Pretty_print & pp )
   if( !rdec.load() ) return 5;
   while( !rdec.finished() )
     {
+    flush_batches();
     const int pos_state = data_position() & pos_state_mask;
     if( rdec.decode_bit( bm_match[state()][pos_state] ) == 0 )	// 1st bit
       {
       // literal byte
       Bit_model * const bm = bm_literal[get_lit_state(peek_prev())];
       if( state.is_char_set_char() )
-        put_byte( rdec.decode_tree8( bm ) );
+        put_byte( branchless ? rdec.decode_tree8_bl( bm ) :
+                               rdec.decode_tree8( bm ) );
       else
-        put_byte( rdec.decode_matched( bm, peek( rep0 ) ) );
+        put_byte( branchless ? rdec.decode_matched_bl( bm, peek( rep0 ) ) :
+                               rdec.decode_matched( bm, peek( rep0 ) ) );
       continue;
       }
     // match or repeated match
@@ -225,13 +245,16 @@ int LZ_decoder::decode_member( const Pretty_print & pp )
         rep0 = distance;
         }
       state.set_rep();
-      len = rdec.decode_len( rep_len_model, pos_state );
+      len = branchless ? rdec.decode_len_bl( rep_len_model, pos_state ) :
+                         rdec.decode_len( rep_len_model, pos_state );
       }
     else					// match
       {
       rep3 = rep2; rep2 = rep1; rep1 = rep0;
-      len = rdec.decode_len( match_len_model, pos_state );
-      rep0 = rdec.decode_tree6( bm_dis_slot[get_len_state(len)] );
+      len = branchless ? rdec.decode_len_bl( match_len_model, pos_state ) :
+                         rdec.decode_len( match_len_model, pos_state );
+      Bit_model * const bm = bm_dis_slot[get_len_state(len)];
+      rep0 = branchless ? rdec.decode_tree6_bl( bm ) : rdec.decode_tree6( bm );
       if( rep0 >= start_dis_model )
         {
         const unsigned dis_slot = rep0;
@@ -265,3 +288,6 @@ int LZ_decoder::decode_member( const Pretty_print & pp )
   flush_data();
   return 2;
   }
+
+template int LZ_decoder::decode_member_< false >( const Pretty_print & pp );
+template int LZ_decoder::decode_member_< true >( const Pretty_print & pp );
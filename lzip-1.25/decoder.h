@@ -254,23 +254,113 @@ len3:
     decode_symbol_bit( bm[symbol], symbol );
     return ( symbol & mask ) + min_match_len + offset;
     }
+
+  /* Branchless counterparts of the bit and tree decoders above. Compressed
+     data is close to random, so instead of branching on each bit they
+     select the new range, code, and probability with masks. The tree
+     decoders work on local copies of range and code, which the compiler
+     can keep in registers. */
+  void normalize( uint32_t & rng, uint32_t & cod )
+    {
+    if( rng <= 0x00FFFFFFU ) { rng <<= 8; cod = ( cod << 8 ) | get_byte(); }
+    }
+
+  static unsigned decode_bit_bl( Bit_model & bm, uint32_t & rng,
+                                 uint32_t & cod )
+    {
+    const uint32_t bound = ( rng >> bit_model_total_bits ) * bm.probability;
+    const uint32_t mask = 0U - ( cod >= bound );	// all ones if bit is 1
+    const int m = mask;
+    const int p = bm.probability;
+    cod -= bound & mask;
+    rng = bound + ( ( rng - 2 * bound ) & mask );
+    bm.probability = p +
+      ( ( ( bit_model_total - p ) >> bit_model_move_bits ) & ~m ) -
+      ( ( p >> bit_model_move_bits ) & m );
+    return mask & 1;
+    }
+
+  bool decode_bit_bl( Bit_model & bm )
+    { normalize(); return decode_bit_bl( bm, range, code ); }
+
+  unsigned decode_tree_bl( Bit_model bm[], const int num_bits )
+    {
+    uint32_t rng = range, cod = code;
+    unsigned symbol = 1;
+    for( int i = 0; i < num_bits; ++i )
+      {
+      normalize( rng, cod );
+      symbol = ( symbol << 1 ) | decode_bit_bl( bm[symbol], rng, cod );
+      }
+    range = rng; code = cod;
+    return symbol - ( 1U << num_bits );
+    }
+
+  unsigned decode_tree6_bl( Bit_model bm[] ) { return decode_tree_bl( bm, 6 ); }
+  unsigned decode_tree8_bl( Bit_model bm[] ) { return decode_tree_bl( bm, 8 ); }
+
+  unsigned decode_matched_bl( Bit_model bm[], unsigned match_byte )
+    {
+    uint32_t rng = range, cod = code;
+    unsigned symbol = 1;
+    unsigned mask = 0x100;
+    do {
+      const unsigned match_bit = ( match_byte <<= 1 ) & mask;
+      normalize( rng, cod );
+      const unsigned bit = decode_bit_bl( bm[symbol+match_bit+mask], rng, cod );
+      symbol = ( symbol << 1 ) | bit;
+      mask &= ~( match_bit ^ ( bit << 8 ) );	// if( match_bit != bit ) mask = 0;
+      } while( symbol < 0x100 );
+    range = rng; code = cod;
+    return symbol & 0xFF;
+    }
+
+  unsigned decode_len_bl( Len_model & lm, const int pos_state )
+    {
+    if( decode_bit_bl( lm.choice1 ) == 0 )
+      return decode_tree_bl( lm.bm_low[pos_state], 3 ) + min_match_len;
+    if( decode_bit_bl( lm.choice2 ) == 0 )
+      return decode_tree_bl( lm.bm_mid[pos_state], 3 ) +
+             min_match_len + len_low_symbols;
+    return decode_tree_bl( lm.bm_high, 8 ) +
+           min_match_len + len_low_symbols + len_mid_symbols;
+    }
   };
 
 
 class LZ_decoder
   {
+  enum { crc_size = 65536,	// bytes checked per batch
+         write_size = 1 << 20 };	// min bytes written per batch
   unsigned long long partial_data_pos;
   Range_decoder & rdec;
   const unsigned dictionary_size;
   uint8_t * const buffer;	// output buffer
   unsigned pos;			// current pos in buffer
+  unsigned crc_pos;		// first byte not yet checked
   unsigned stream_pos;		// first byte not yet written to file
   uint32_t crc_;
   const int outfd;		// output file descriptor
   bool pos_wrapped;
 
+  void update_crc( const unsigned end );
+  void write_data( const unsigned end );
   void flush_data();
+
+  /* Check the completed batches of crc_size bytes while they are still in
+     the cache, and write them once at least write_size bytes are checked,
+     instead of waiting for the buffer to fill. */
+  void flush_batches()
+    {
+    if( pos - crc_pos >= crc_size )
+      {
+      update_crc( pos & ~( crc_size - 1U ) );
+      if( crc_pos - stream_pos >= write_size ) write_data( crc_pos );
+      }
+    }
+
   bool check_trailer( const Pretty_print & pp ) const;
+  template< bool branchless > int decode_member_( const Pretty_print & pp );
 
   uint8_t peek_prev() const
     { return buffer[((pos > 0) ? pos : dictionary_size)-1]; }
@@ -330,6 +420,7 @@ public:
     dictionary_size( dict_size ),
     buffer( new uint8_t[dictionary_size] ),
     pos( 0 ),
+    crc_pos( 0 ),
     stream_pos( 0 ),
     crc_( 0xFFFFFFFFU ),
     outfd( ofd ),
@@ -342,5 +433,7 @@ public:
   unsigned crc() const { return crc_ ^ 0xFFFFFFFFU; }
   unsigned long long data_position() const { return partial_data_pos + pos; }
 
-  int decode_member( const Pretty_print & pp );
+  int decode_member( const Pretty_print & pp, const bool branchless = false )
+    { return branchless ? decode_member_< true >( pp ) :
+                          decode_member_< false >( pp ); }
   };
@@ -33,9 +33,10 @@
 const CRC32 crc32;
 
 
-int LZ_encoder::get_match_pairs( Pair * pairs )
+template< int fixed_len_limit >
+int LZ_encoder< fixed_len_limit >::get_match_pairs( Pair * pairs )
   {
-  int len_limit = match_len_limit;
+  int len_limit = match_len_limit();
   if( len_limit > available_bytes() )
     {
     len_limit = available_bytes();
@@ -47,12 +48,20 @@ int LZ_encoder::get_match_pairs( Pair * pairs )
   const int min_pos = ( pos > dictionary_size ) ? pos - dictionary_size : 0;
   const uint8_t * const data = ptr_to_current_pos();
 
-  unsigned tmp = crc32[data[0]] ^ data[1];
-  const int key2 = tmp & ( num_prev_positions2 - 1 );
-  tmp ^= (unsigned)data[2] << 8;
-  const int key3 = num_prev_positions2 + ( tmp & ( num_prev_positions3 - 1 ) );
-  const int key4 = num_prev_positions23 +
-                   ( ( tmp ^ ( crc32[data[3]] << 5 ) ) & key4_mask );
+  int key2, key3, key4;
+  get_keys( data, key2, key3, key4 );
+
+  /* Hide the latency of the next calls. The buckets of pos + 1 were
+     prefetched by the previous call, so now its root node can be fetched. */
+  if( available_bytes() > prefetch_distance + 3 )
+    {
+    int k2, k3, k4;
+    get_keys( data + 1, k2, k3, k4 );
+    prefetch_node( prev_positions[k4] );
+    get_keys( data + prefetch_distance, k2, k3, k4 );
+    prefetch_bucket( k3 );
+    prefetch_bucket( k4 );
+    }
 
   if( pairs )
     {
@@ -90,7 +99,7 @@ int LZ_encoder::get_match_pairs( Pair * pairs )
   int32_t * ptr1 = ptr0 + 1;
   int len = 0, len0 = 0, len1 = 0;
 
-  for( int count = cycles; ; )
+  for( int count = cycles(); ; )
     {
     if( newpos1 <= min_pos || --count < 0 ) { *ptr0 = *ptr1 = 0; break; }
 
@@ -133,37 +142,61 @@ int LZ_encoder::get_match_pairs( Pair * pairs )
   }
 
 
-void LZ_encoder::update_distance_prices()
+/* Only the prices of the models changed since the last call are
+   recalculated. The result is the same as recalculating all of them. */
+template< int fixed_len_limit >
+void LZ_encoder< fixed_len_limit >::update_distance_prices()
   {
-  for( int dis = start_dis_model; dis < modeled_distances; ++dis )
+  for( int dis_slot = start_dis_model; dis_slot < end_dis_model; ++dis_slot )
     {
-    const int dis_slot = dis_slots[dis];
+    if( !dis_dirty[dis_slot] ) continue;
     const int direct_bits = ( dis_slot >> 1 ) - 1;
     const int base = ( 2 | ( dis_slot & 1 ) ) << direct_bits;
-    const int price = price_symbol_reversed( bm_dis + ( base - dis_slot ),
-                                             dis - base, direct_bits );
-    for( int len_state = 0; len_state < len_states; ++len_state )
-      dis_prices[len_state][dis] = price;
+    const int end = base + ( 1 << direct_bits );
+    for( int dis = base; dis < end; ++dis )
+      direct_dis_prices[dis] = price_symbol_reversed( bm_dis +
+                               ( base - dis_slot ), dis - base, direct_bits );
     }
 
   for( int len_state = 0; len_state < len_states; ++len_state )
     {
     int * const dsp = dis_slot_prices[len_state];
-    const Bit_model * const bmds = bm_dis_slot[len_state];
-    int slot = 0;
-    for( ; slot < end_dis_model; ++slot )
-      dsp[slot] = price_symbol6( bmds, slot );
-    for( ; slot < num_dis_slots; ++slot )
-      dsp[slot] = price_symbol6( bmds, slot ) +
-                  (((( slot >> 1 ) - 1 ) - dis_align_bits ) << price_shift_bits );
+    const bool slot_dirty = dis_slot_dirty[len_state];
+    if( slot_dirty )
+      {
+      const Bit_model * const bmds = bm_dis_slot[len_state];
+      int slot = 0;
+      for( ; slot < end_dis_model; ++slot )
+        dsp[slot] = price_symbol6( bmds, slot );
+      for( ; slot < num_dis_slots; ++slot )
+        dsp[slot] = price_symbol6( bmds, slot ) +
+          (((( slot >> 1 ) - 1 ) - dis_align_bits ) << price_shift_bits );
+      }
 
     int * const dp = dis_prices[len_state];
-    int dis = 0;
-    for( ; dis < start_dis_model; ++dis )
-      dp[dis] = dsp[dis];
-    for( ; dis < modeled_distances; ++dis )
-      dp[dis] += dsp[dis_slots[dis]];
+    if( slot_dirty )
+      for( int dis = 0; dis < start_dis_model; ++dis )
+        dp[dis] = dsp[dis];
+    for( int dis = start_dis_model; dis < modeled_distances; ++dis )
+      {
+      const int dis_slot = dis_slots[dis];
+      if( slot_dirty || dis_dirty[dis_slot] )
+        dp[dis] = direct_dis_prices[dis] + dsp[dis_slot];
+      }
+    dis_slot_dirty[len_state] = false;
     }
+  for( int dis_slot = start_dis_model; dis_slot < end_dis_model; ++dis_slot )
+    dis_dirty[dis_slot] = false;
+  }
+
+
+template< int fixed_len_limit >
+void LZ_encoder< fixed_len_limit >::update_align_prices()
+  {
+  if( !align_dirty ) return;
+  for( int i = 0; i < dis_align_size; ++i )
+    align_prices[i] = price_symbol_reversed( bm_align, i, dis_align_bits );
+  align_dirty = false;
   }
 
 
@@ -172,8 +205,9 @@ void LZ_encoder::update_distance_prices()
    ( trials[0].dis4 == -1 ) means literal.
    A match/rep longer or equal than match_len_limit finishes the sequence.
 */
-int LZ_encoder::sequence_optimizer( const int reps[num_rep_distances],
-                                    const State state )
+template< int fixed_len_limit >
+int LZ_encoder< fixed_len_limit >::sequence_optimizer(
+    const int reps[num_rep_distances], const State state )
   {
   int num_pairs, num_trials;
 
@@ -193,7 +227,7 @@ int LZ_encoder::sequence_optimizer( const int reps[num_rep_distances],
     replens[i] = true_match_len( 0, reps[i] + 1 );
     if( replens[i] > replens[rep_index] ) rep_index = i;
     }
-  if( replens[rep_index] >= match_len_limit )
+  if( replens[rep_index] >= match_len_limit() )
     {
     trials[0].price = replens[rep_index];
     trials[0].dis4 = rep_index;
@@ -201,7 +235,7 @@ int LZ_encoder::sequence_optimizer( const int reps[num_rep_distances],
     return replens[rep_index];
     }
 
-  if( main_len >= match_len_limit )
+  if( main_len >= match_len_limit() )
     {
     trials[0].price = main_len;
     trials[0].dis4 = pairs[num_pairs-1].dis + num_rep_distances;
@@ -279,7 +313,7 @@ int LZ_encoder::sequence_optimizer( const int reps[num_rep_distances],
 
     const int num_pairs = read_match_distances();
     const int newlen = ( num_pairs > 0 ) ? pairs[num_pairs-1].len : 0;
-    if( newlen >= match_len_limit )
+    if( newlen >= match_len_limit() )
       {
       pending_num_pairs = num_pairs;
       backward( cur );
@@ -355,14 +389,14 @@ int LZ_encoder::sequence_optimizer( const int reps[num_rep_distances],
       std::min( available_bytes(), max_num_trials - 1 - cur );
     if( triable_bytes < min_match_len ) continue;
 
-    const int len_limit = std::min( match_len_limit, triable_bytes );
+    const int len_limit = std::min( match_len_limit(), triable_bytes );
 
     // try literal + rep0
     if( match_byte != cur_byte && next_trial.prev_index != cur )
       {
       const uint8_t * const data = ptr_to_current_pos();
       const int dis = cur_trial.reps[0] + 1;
-      const int limit = std::min( match_len_limit + 1, triable_bytes );
+      const int limit = std::min( match_len_limit() + 1, triable_bytes );
       int len = 1;
       while( len < limit && data[len-dis] == data[len] ) ++len;
       if( --len >= min_match_len )
@@ -402,7 +436,7 @@ int LZ_encoder::sequence_optimizer( const int reps[num_rep_distances],
 
       // try rep + literal + rep0
       int len2 = len + 1;
-      const int limit = std::min( match_len_limit + len2, triable_bytes );
+      const int limit = std::min( match_len_limit() + len2, triable_bytes );
       while( len2 < limit && data[len2-dis] == data[len2] ) ++len2;
       len2 -= len + 1;
       if( len2 < min_match_len ) continue;
@@ -445,7 +479,7 @@ int LZ_encoder::sequence_optimizer( const int reps[num_rep_distances],
           const uint8_t * const data = ptr_to_current_pos();
           const int dis2 = dis + 1;
           int len2 = len + 1;
-          const int limit = std::min( match_len_limit + len2, triable_bytes );
+          const int limit = std::min( match_len_limit() + len2, triable_bytes );
           while( len2 < limit && data[len2-dis2] == data[len2] ) ++len2;
           len2 -= len + 1;
           if( len2 >= min_match_len )
@@ -474,14 +508,17 @@ int LZ_encoder::sequence_optimizer( const int reps[num_rep_distances],
   }
 
 
-bool LZ_encoder::encode_member( const unsigned long long member_size )
+template< int fixed_len_limit >
+bool LZ_encoder< fixed_len_limit >::encode_member(
+    const unsigned long long member_size )
   {
   const unsigned long long member_size_limit =
     member_size - Lzip_trailer::size - max_marker_size;
-  const bool best = match_len_limit > 12;
-  const int dis_price_count = best ? 1 : 512;
-  const int align_price_count = best ? 1 : dis_align_size;
-  const int price_count = ( match_len_limit > 36 ) ? 1013 : 4093;
+  const bool best = match_len_limit() > 12;
+  const int dis_price_count = ( best ? 1 : 512 ) * price_factor;
+  const int align_price_count = ( best ? 1 : dis_align_size ) * price_factor;
+  const int price_count =
+    ( ( match_len_limit() > 36 ) ? 1013 : 4093 ) * price_factor;
   int price_counter = 0;		// counters may decrement below 0
   int dis_price_counter = 0;
   int align_price_counter = 0;
@@ -513,8 +550,7 @@ bool LZ_encoder::encode_member( const unsigned long long member_size )
       if( align_price_counter <= 0 )
         {
         align_price_counter = align_price_count;
-        for( int i = 0; i < dis_align_size; ++i )
-          align_prices[i] = price_symbol_reversed( bm_align, i, dis_align_bits );
+        update_align_prices();
         }
       match_len_prices.update_prices();
       rep_len_prices.update_prices();
@@ -566,7 +602,7 @@ bool LZ_encoder::encode_member( const unsigned long long member_size )
           else
             {
             renc.encode_len( rep_len_model, len, pos_state );
-            rep_len_prices.decrement_counter( pos_state );
+            rep_len_prices.decrement_counter( pos_state, len );
             state.set_rep();
             }
           }
@@ -574,9 +610,13 @@ bool LZ_encoder::encode_member( const unsigned long long member_size )
           {
           dis -= num_rep_distances;
           encode_pair( dis, len, pos_state );
-          if( dis >= modeled_distances ) --align_price_counter;
+          const int dis_slot = get_slot( dis );
+          dis_slot_dirty[get_len_state(len)] = true;
+          if( dis_slot >= end_dis_model )
+            { --align_price_counter; align_dirty = true; }
+          else if( dis_slot >= start_dis_model ) dis_dirty[dis_slot] = true;
           --dis_price_counter;
-          match_len_prices.decrement_counter( pos_state );
+          match_len_prices.decrement_counter( pos_state, len );
           state.set_match();
           }
         }
@@ -592,3 +632,33 @@ bool LZ_encoder::encode_member( const unsigned long long member_size )
   full_flush( state );
   return true;
   }
+
+
+LZ_encoder_base * new_LZ_encoder( const int dict_size, const int len_limit,
+                                  const int ifd, const int outfd,
+                                  const int price_factor )
+  {
+  switch( len_limit )		// match length limits of levels -1 to -9
+    {
+    case   5: return new LZ_encoder<   5 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    case   6: return new LZ_encoder<   6 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    case   8: return new LZ_encoder<   8 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    case  12: return new LZ_encoder<  12 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    case  20: return new LZ_encoder<  20 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    case  36: return new LZ_encoder<  36 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    case  68: return new LZ_encoder<  68 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    case 132: return new LZ_encoder< 132 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    case 273: return new LZ_encoder< 273 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    default:  return new LZ_encoder<   0 >( dict_size, len_limit, ifd, outfd,
+                                             price_factor );
+    }
+  }
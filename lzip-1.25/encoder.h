@@ -15,24 +15,36 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-class Len_prices
+/* 'fixed_len_limit' is the match length limit known at compile time, or 0
+   if it is only known at run time. */
+template< int fixed_len_limit > class Len_prices
   {
   const Len_model & lm;
-  const int len_symbols;
-  const int count;
+  const int match_len_limit_;
+  const int price_factor;		// multiplies the update interval
   int prices[pos_states][max_len_symbols];
+  int high_symbol_prices[len_high_symbols];	// prices of lm.bm_high
   int counters[pos_states];			// may decrement below 0
+  bool high_dirty;				// lm.bm_high has changed
+
+  int match_len_limit() const
+    { return fixed_len_limit ? fixed_len_limit : match_len_limit_; }
+  int len_symbols() const { return match_len_limit() + 1 - min_match_len; }
+  int count() const
+    { return ( ( match_len_limit() > 12 ) ? 1 : len_symbols() ) *
+             price_factor; }
 
   void update_low_mid_prices( const int pos_state )
     {
     int * const pps = prices[pos_state];
     int tmp = price0( lm.choice1 );
     int len = 0;
-    for( ; len < len_low_symbols && len < len_symbols; ++len )
+    for( ; len < len_low_symbols && len < len_symbols(); ++len )
       pps[len] = tmp + price_symbol3( lm.bm_low[pos_state], len );
-    if( len >= len_symbols ) return;
+    if( len >= len_symbols() ) return;
     tmp = price1( lm.choice1 ) + price0( lm.choice2 );
-    for( ; len < len_low_symbols + len_mid_symbols && len < len_symbols; ++len )
+    for( ; len < len_low_symbols + len_mid_symbols && len < len_symbols();
+         ++len )
       pps[len] = tmp +
                  price_symbol3( lm.bm_mid[pos_state], len - len_low_symbols );
     }
@@ -40,32 +52,48 @@ class Len_prices
   void update_high_prices()
     {
     const int tmp = price1( lm.choice1 ) + price1( lm.choice2 );
-    for( int len = len_low_symbols + len_mid_symbols; len < len_symbols; ++len )
+    for( int len = len_low_symbols + len_mid_symbols; len < len_symbols();
+         ++len )
+      {
+      int & hsp = high_symbol_prices[len-len_low_symbols-len_mid_symbols];
+      if( high_dirty )
+        hsp = price_symbol8( lm.bm_high,
+                             len - len_low_symbols - len_mid_symbols );
       // using 4 slots per value makes "price" faster
-      prices[3][len] = prices[2][len] = prices[1][len] = prices[0][len] = tmp +
-        price_symbol8( lm.bm_high, len - len_low_symbols - len_mid_symbols );
+      prices[3][len] = prices[2][len] = prices[1][len] = prices[0][len] =
+        tmp + hsp;
+      }
+    high_dirty = false;
     }
 
 public:
-  void reset() { for( int i = 0; i < pos_states; ++i ) counters[i] = 0; }
+  void reset()
+    { for( int i = 0; i < pos_states; ++i ) counters[i] = 0;
+      high_dirty = true; }
 
-  Len_prices( const Len_model & m, const int match_len_limit )
+  Len_prices( const Len_model & m, const int len_limit, const int factor )
     :
     lm( m ),
-    len_symbols( match_len_limit + 1 - min_match_len ),
-    count( ( match_len_limit > 12 ) ? 1 : len_symbols )
+    match_len_limit_( len_limit ),
+    price_factor( factor )
     { reset(); }
 
-  void decrement_counter( const int pos_state ) { --counters[pos_state]; }
+  // call after encoding 'len' with lm
+  void decrement_counter( const int pos_state, const int len )
+    {
+    --counters[pos_state];
+    if( len >= min_match_len + len_low_symbols + len_mid_symbols )
+      high_dirty = true;
+    }
 
   void update_prices()
     {
     bool high_pending = false;
     for( int pos_state = 0; pos_state < pos_states; ++pos_state )
       if( counters[pos_state] <= 0 )
-        { counters[pos_state] = count;
+        { counters[pos_state] = count();
           update_low_mid_prices( pos_state ); high_pending = true; }
-    if( high_pending && len_symbols > len_low_symbols + len_mid_symbols )
+    if( high_pending && len_symbols() > len_low_symbols + len_mid_symbols )
       update_high_prices();
     }
 
@@ -74,7 +102,10 @@ public:
   };
 
 
-class LZ_encoder : public LZ_encoder_base
+/* The encoder core is instantiated for the match length limit of each
+   standard level so that the compiler can fold it in the inner loops.
+   LZ_encoder< 0 > takes the limit at run time. */
+template< int fixed_len_limit > class LZ_encoder : public LZ_encoder_base
   {
   struct Pair			// distance-length pair
     {
@@ -121,18 +152,31 @@ class LZ_encoder : public LZ_encoder_base
       }
     };
 
-  const int cycles;
-  const int match_len_limit;
-  Len_prices match_len_prices;
-  Len_prices rep_len_prices;
+  const int cycles_;
+  const int match_len_limit_;
+  const int price_factor;	// multiplies the price update intervals
+  Len_prices< fixed_len_limit > match_len_prices;
+  Len_prices< fixed_len_limit > rep_len_prices;
   int pending_num_pairs;
   Pair pairs[max_match_len+1];
   Trial trials[max_num_trials];
 
   int dis_slot_prices[len_states][2*max_dictionary_bits];
   int dis_prices[len_states][modeled_distances];
+  int direct_dis_prices[modeled_distances];	// bm_dis part of dis_prices
   int align_prices[dis_align_size];
   const int num_dis_slots;
+  // the models below have changed since their prices were last computed
+  bool dis_slot_dirty[len_states];
+  bool dis_dirty[end_dis_model];		// bm_dis of each dis_slot
+  bool align_dirty;
+
+  static int cycles_for( const int len_limit )
+    { return ( len_limit < max_match_len ) ? 16 + ( len_limit / 2 ) : 256; }
+  int cycles() const
+    { return fixed_len_limit ? cycles_for( fixed_len_limit ) : cycles_; }
+  int match_len_limit() const
+    { return fixed_len_limit ? fixed_len_limit : match_len_limit_; }
 
   bool dec_pos( const int ahead )
     {
@@ -143,8 +187,28 @@ class LZ_encoder : public LZ_encoder_base
     return true;
     }
 
+  // compute the hash keys of the 2, 3 and 4 bytes at 'data'
+  void get_keys( const uint8_t * const data,
+                 int & key2, int & key3, int & key4 ) const
+    {
+    unsigned tmp = crc32[data[0]] ^ data[1];
+    key2 = tmp & ( num_prev_positions2 - 1 );
+    tmp ^= (unsigned)data[2] << 8;
+    key3 = num_prev_positions2 + ( tmp & ( num_prev_positions3 - 1 ) );
+    key4 = num_prev_positions23 +
+           ( ( tmp ^ ( crc32[data[3]] << 5 ) ) & key4_mask );
+    }
+
   int get_match_pairs( Pair * pairs = 0 );
   void update_distance_prices();
+  void update_align_prices();
+
+  void set_prices_dirty()
+    {
+    for( int i = 0; i < len_states; ++i ) dis_slot_dirty[i] = true;
+    for( int i = 0; i < end_dis_model; ++i ) dis_dirty[i] = true;
+    align_dirty = true;
+    }
 
        // move-to-front dis in/into reps; do nothing if( dis4 <= 0 )
   static void mtf_reps( const int dis4, int reps[num_rep_distances] )
@@ -205,7 +269,7 @@ class LZ_encoder : public LZ_encoder_base
     if( num_pairs > 0 )
       {
       const int len = pairs[num_pairs-1].len;
-      if( len == match_len_limit && len < max_match_len )
+      if( len == match_len_limit() && len < max_match_len )
         pairs[num_pairs-1].len =
           true_match_len( len, pairs[num_pairs-1].dis + 1 );
       }
@@ -259,23 +323,26 @@ class LZ_encoder : public LZ_encoder_base
          num_prev_positions3 = 1 << 16,
          num_prev_positions2 = 1 << 10,
          num_prev_positions23 = num_prev_positions2 + num_prev_positions3,
-         pos_array_factor = 2 };
+         pos_array_factor = 2,
+         prefetch_distance = 2 };	// positions ahead to prefetch buckets
 
 public:
   LZ_encoder( const int dict_size, const int len_limit,
-              const int ifd, const int outfd )
+              const int ifd, const int outfd, const int factor )
     :
     LZ_encoder_base( before_size, dict_size, after_size, dict_factor,
                      num_prev_positions23, pos_array_factor, ifd, outfd ),
-    cycles( ( len_limit < max_match_len ) ? 16 + ( len_limit / 2 ) : 256 ),
-    match_len_limit( len_limit ),
-    match_len_prices( match_len_model, match_len_limit ),
-    rep_len_prices( rep_len_model, match_len_limit ),
+    cycles_( cycles_for( len_limit ) ),
+    match_len_limit_( len_limit ),
+    price_factor( factor ),
+    match_len_prices( match_len_model, len_limit, factor ),
+    rep_len_prices( rep_len_model, len_limit, factor ),
     pending_num_pairs( 0 ),
     num_dis_slots( 2 * real_bits( dictionary_size - 1 ) )
     {
     trials[1].prev_index = 0;
     trials[1].prev_index2 = single_step_trial;
+    set_prices_dirty();
     }
 
   void reset()
@@ -284,7 +351,15 @@ public:
     match_len_prices.reset();
     rep_len_prices.reset();
     pending_num_pairs = 0;
+    set_prices_dirty();
     }
 
   bool encode_member( const unsigned long long member_size );
   };
+
+/* Return an LZ_encoder specialized for 'len_limit' if there is one.
+   'price_factor' multiplies the intervals between price updates; values
+   greater than 1 trade compression ratio for speed. */
+LZ_encoder_base * new_LZ_encoder( const int dict_size, const int len_limit,
+                                  const int ifd, const int outfd,
+                                  const int price_factor = 1 );
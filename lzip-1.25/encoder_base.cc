@@ -73,7 +73,7 @@ void Matchfinder_base::normalize_pos()
 Matchfinder_base::Matchfinder_base( const int before_size_,
                     const int dict_size, const int after_size,
                     const int dict_factor, const int num_prev_positions23_,
-                    const int pos_array_factor, const int ifd )
+                    const int pos_array_factor_, const int ifd )
   :
   partial_data_pos( 0 ),
   before_size( before_size_ ),
@@ -81,6 +81,7 @@ Matchfinder_base::Matchfinder_base( const int before_size_,
   cyclic_pos( 0 ),
   stream_pos( 0 ),
   num_prev_positions23( num_prev_positions23_ ),
+  pos_array_factor( pos_array_factor_ ),
   infd( ifd ),
   at_stream_end( false )
   {
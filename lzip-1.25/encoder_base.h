@@ -160,6 +160,17 @@ inline int price_matched( const Bit_model bm[], unsigned symbol,
   }
 
 
+// Ask the cache to load the line containing 'p'. Does not fault.
+inline void prefetch( const void * const p )
+  {
+#if defined __GNUC__
+  __builtin_prefetch( p );
+#else
+  (void)p;
+#endif
+  }
+
+
 class Matchfinder_base
   {
   bool read_block();
@@ -184,6 +195,7 @@ protected:
   const int num_prev_positions23;
   int num_prev_positions;	// size of prev_positions
   int pos_array_size;
+  const int pos_array_factor;	// nodes per position in pos_array
   const int infd;		// input file descriptor
   bool at_stream_end;		// stream_pos shows real end of file
 
@@ -195,6 +207,19 @@ protected:
   ~Matchfinder_base()
     { delete[] prev_positions; std::free( buffer ); }
 
+  void prefetch_bucket( const int key ) const
+    { prefetch( prev_positions + key ); }
+
+  // prefetch the tree or chain node of the position stored as 'newpos1'
+  void prefetch_node( const int newpos1 ) const
+    {
+    const int delta = pos + 1 - newpos1;
+    if( newpos1 <= 0 || delta < 0 || delta > dictionary_size ) return;
+    int i = cyclic_pos - delta;
+    if( i < 0 ) i += dictionary_size + 1;
+    prefetch( pos_array + i * pos_array_factor );
+    }
+
 public:
   uint8_t peek( const int distance ) const { return buffer[pos-distance]; }
   int available_bytes() const { return stream_pos - pos; }
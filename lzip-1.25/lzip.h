@@ -315,8 +315,10 @@ struct Cl_options		// command-line options
   {
   bool ignore_trailing;
   bool loose_trailing;
+  bool branchless;		// use the branchless bit decoder
 
-  Cl_options() : ignore_trailing( true ), loose_trailing( false ) {}
+  Cl_options()
+    : ignore_trailing( true ), loose_trailing( false ), branchless( false ) {}
   };
 
 
@@ -329,6 +331,16 @@ struct Error
 inline void set_retval( int & retval, const int new_val )
   { if( retval < new_val ) retval = new_val; }
 
+// Return the value of the CPU cycle counter, or 0 if not available.
+inline unsigned long long read_cycle_counter()
+  {
+#if defined __GNUC__ && ( defined __x86_64__ || defined __i386__ )
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+  }
+
 const char * const bad_magic_msg = "Bad magic number (file not in lzip format).";
 const char * const bad_dict_msg = "Invalid dictionary size in member header.";
 const char * const corrupt_mm_msg = "Corrupt header in multimember file.";
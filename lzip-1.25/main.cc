@@ -145,8 +145,14 @@ void show_help()
                "  -0 .. -9                       set compression level [default 6]\n"
                "      --fast                     alias for -0\n"
                "      --best                     alias for -9\n"
-               "      --loose-trailing           allow trailing data seeming corrupt header\n"
-               "\nIf no file names are given, or if a file is '-', lzip compresses or\n"
+               "      --loose-trailing           allow trailing data seeming corrupt header\n" );
+  if( verbosity >= 1 )
+    {
+    std::printf( "      --branchless               use the branchless bit decoder\n"
+                 "      --debug=<level>            print debug statistics(1) to stderr\n"
+                 "      --price-interval=<n>       update prices n times less often [1]\n" );
+    }
+  std::printf( "\nIf no file names are given, or if a file is '-', lzip compresses or\n"
                "decompresses from standard input to standard output.\n"
                "Numbers may be followed by a multiplier: k = kB = 10^3 = 1000,\n"
                "Ki = KiB = 2^10 = 1024, M = 10^6, Mi = 2^20, G = 10^9, Gi = 2^30, etc...\n"
@@ -596,7 +602,8 @@ int compress( const unsigned long long cfile_size,
               const unsigned long long member_size,
               const unsigned long long volume_size, const int infd,
               const Lzma_options & encoder_options, const Pretty_print & pp,
-              const struct stat * const in_statsp, const bool zero )
+              const struct stat * const in_statsp, const bool zero,
+              const int price_factor, const int debug_level )
   {
   LZ_encoder_base * encoder = 0;		// polymorphic encoder
   if( verbosity >= 1 ) pp();
@@ -609,20 +616,24 @@ int compress( const unsigned long long cfile_size,
     if( header.dictionary_size( encoder_options.dictionary_size ) &&
         encoder_options.match_len_limit >= min_match_len_limit &&
         encoder_options.match_len_limit <= max_match_len )
-      encoder = new LZ_encoder( header.dictionary_size(),
-                                encoder_options.match_len_limit, infd, outfd );
+      encoder = new_LZ_encoder( header.dictionary_size(),
+                                encoder_options.match_len_limit, infd, outfd,
+                                price_factor );
     else internal_error( "invalid argument to encoder." );
     }
 
   unsigned long long in_size = 0, out_size = 0, partial_volume_size = 0;
+  unsigned long long cycles = 0;		// spent in encode_member
   int retval = 0;
   while( true )		// encode one member per iteration
     {
     const unsigned long long size = (volume_size > 0) ?
       std::min( member_size, volume_size - partial_volume_size ) : member_size;
     show_cprogress( cfile_size, in_size, encoder, &pp );	// init
+    const unsigned long long start_cycles = read_cycle_counter();
     if( !encoder->encode_member( size ) )
       { pp( "Encoder error." ); retval = 1; break; }
+    cycles += read_cycle_counter() - start_cycles;
     in_size += encoder->data_position();
     out_size += encoder->member_position();
     if( encoder->data_finished() ) break;
@@ -656,6 +667,14 @@ int compress( const unsigned long long cfile_size,
                     100.0 - ( ( 100.0 * out_size ) / in_size ),
                     in_size, out_size );
     }
+  if( retval == 0 && ( debug_level & 1 ) && in_size > 0 )
+    {
+    if( cycles == 0 )
+      std::fputs( "encoder: cycle counter not available.\n", stderr );
+    else
+      std::fprintf( stderr, "encoder: %llu cycles, %.2f cycles/byte\n",
+                    cycles, (double)cycles / in_size );
+    }
   delete encoder;
   return retval;
   }
@@ -697,9 +716,11 @@ bool show_trailing_data( const uint8_t * const data, const int size,
 
 int decompress( const unsigned long long cfile_size, const int infd,
                 const Cl_options & cl_opts, const Pretty_print & pp,
-                const bool from_stdin, const bool testing )
+                const bool from_stdin, const bool testing,
+                const int debug_level )
   {
-  unsigned long long partial_file_pos = 0;
+  unsigned long long partial_file_pos = 0, data_size = 0;
+  unsigned long long cycles = 0;		// spent in decode_member
   Range_decoder rdec( infd );
   int retval = 0;
   bool empty = false, multi = false;
@@ -742,7 +763,10 @@ int decompress( const unsigned long long cfile_size, const int infd,
 
     LZ_decoder decoder( rdec, dictionary_size, outfd );
     show_dprogress( cfile_size, partial_file_pos, &rdec, &pp );	// init
-    const int result = decoder.decode_member( pp );
+    const unsigned long long start_cycles = read_cycle_counter();
+    const int result = decoder.decode_member( pp, cl_opts.branchless );
+    cycles += read_cycle_counter() - start_cycles;
+    data_size += decoder.data_position();
     partial_file_pos += rdec.member_position();
     if( result != 0 )
       {
@@ -765,6 +789,16 @@ int decompress( const unsigned long long cfile_size, const int infd,
     std::fputs( testing ? "ok\n" : "done\n", stderr );
   if( empty && multi && retval == 0 )
     { show_file_error( pp.name(), empty_msg ); retval = 2; }
+  if( retval == 0 && ( debug_level & 1 ) && data_size > 0 )
+    {
+    const char * const type = cl_opts.branchless ? "branchless" : "branchy";
+    if( cycles == 0 )
+      std::fprintf( stderr, "%s decoder: cycle counter not available.\n",
+                    type );
+    else
+      std::fprintf( stderr, "%s decoder: %llu cycles, %.2f cycles/byte\n",
+                    type, cycles, (double)cycles / data_size );
+    }
   return retval;
   }
 
@@ -891,9 +925,11 @@ int main( const int argc, const char * const argv[] )
   bool recompress = false;
   bool to_stdout = false;
   bool zero = false;
+  int debug_level = 0;
+  int price_factor = 1;		// multiplies the price update intervals
   if( argc > 0 ) invocation_name = argv[0];
 
-  enum { opt_lt = 256 };
+  enum { opt_bl = 256, opt_dbg, opt_lt, opt_pi };
   const Arg_parser::Option options[] =
     {
     { '0', "fast",              Arg_parser::no  },
@@ -924,7 +960,10 @@ int main( const int argc, const char * const argv[] )
     { 't', "test",              Arg_parser::no  },
     { 'v', "verbose",           Arg_parser::no  },
     { 'V', "version",           Arg_parser::no  },
+    { opt_bl,  "branchless",    Arg_parser::no  },
+    { opt_dbg, "debug",         Arg_parser::yes },
     { opt_lt, "loose-trailing", Arg_parser::no  },
+    { opt_pi, "price-interval", Arg_parser::yes },
     { 0, 0,                     Arg_parser::no  } };
 
   const Arg_parser parser( argc, argv, options );
@@ -966,7 +1005,10 @@ int main( const int argc, const char * const argv[] )
       case 't': set_mode( program_mode, m_test ); break;
       case 'v': if( verbosity < 4 ) ++verbosity; break;
       case 'V': show_version(); return 0;
+      case opt_bl: cl_opts.branchless = true; break;
+      case opt_dbg: debug_level = getnum( arg, pn, 0, 3 ); break;
       case opt_lt: cl_opts.loose_trailing = true; break;
+      case opt_pi: price_factor = getnum( arg, pn, 1, 64 ); break;
       default: internal_error( "uncaught option." );
       }
     } // end process options
@@ -1068,10 +1110,11 @@ int main( const int argc, const char * const argv[] )
     try {
       if( program_mode == m_compress )
         tmp = compress( cfile_size, member_size, volume_size, infd,
-                        encoder_options, pp, in_statsp, zero );
+                        encoder_options, pp, in_statsp, zero, price_factor,
+                        debug_level );
       else
         tmp = decompress( cfile_size, infd, cl_opts, pp, from_stdin,
-                          program_mode == m_test );
+                          program_mode == m_test, debug_level );
       }
     catch( std::bad_alloc & )
       { pp( ( program_mode == m_compress ) ?
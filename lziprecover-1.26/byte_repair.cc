@@ -120,14 +120,15 @@ const LZ_mtester * prepare_master( const uint8_t * const buffer,
   }
 
 
-bool test_member_rest( const LZ_mtester & master, uint8_t * const buffer2,
+bool test_member_rest( const LZ_mtester & master, Trial_buffer & buffer2,
                        long * const failure_posp = 0 )
   {
   LZ_mtester mtester( master );		// tester with external buffer
   mtester.duplicate_buffer( buffer2 );
-  if( mtester.test_member() == 0 && mtester.finished() ) return true;
-  if( failure_posp ) *failure_posp = mtester.member_position();
-  return false;
+  const bool ok = mtester.test_member() == 0 && mtester.finished();
+  mtester.set_dirty_size( buffer2, master );
+  if( !ok && failure_posp ) *failure_posp = mtester.member_position();
+  return ok;
   }
 
 
@@ -136,14 +137,15 @@ long repair_member( uint8_t * const mbuffer, const long long mpos,
                     const long msize, const long begin, const long end,
                     const unsigned dictionary_size, const char terminator )
   {
-  uint8_t * const buffer2 = new uint8_t[dictionary_size];
+  Trial_buffer buffer2( dictionary_size );
   for( long pos = end; pos >= begin && pos > end - 50000; )
     {
     const long min_pos = std::max( begin, pos - 100 );
     const unsigned long pos_limit = std::max( min_pos - 16, 0L );
     const LZ_mtester * master =
       prepare_master( mbuffer, msize, pos_limit, dictionary_size );
-    if( !master ) { delete[] buffer2; return -1; }
+    if( !master ) return -1;
+    buffer2.reset();
     for( ; pos >= min_pos; --pos )
       {
       if( verbosity >= 2 )
@@ -156,13 +158,12 @@ long repair_member( uint8_t * const mbuffer, const long long mpos,
         {
         ++mbuffer[pos];
         if( test_member_rest( *master, buffer2 ) )
-          { delete master; delete[] buffer2; return pos; }
+          { delete master; return pos; }
         }
       ++mbuffer[pos];
       }
     delete master;
     }
-  delete[] buffer2;
   return 0;
   }
 
@@ -338,7 +339,7 @@ int debug_delay( const std::string & input_filename,
       }
     uint8_t * const mbuffer = read_member( infd, mpos, msize, input_filename );
     if( !mbuffer ) return 1;
-    uint8_t * const buffer2 = new uint8_t[dictionary_size];
+    Trial_buffer buffer2( dictionary_size );
     long pos = std::max( range.pos() - mpos, Lzip_header::size + 1LL );
     const long end = std::min( range.end() - mpos, msize );
     long max_delay = 0;
@@ -348,7 +349,8 @@ int debug_delay( const std::string & input_filename,
       const LZ_mtester * master =
         prepare_master( mbuffer, msize, pos_limit, dictionary_size );
       if( !master ) { show_error( "Can't prepare master." );
-                      delete[] buffer2; delete[] mbuffer; return 1; }
+                      delete[] mbuffer; return 1; }
+      buffer2.reset();
       const long partial_end = std::min( pos + 100, end );
       for( ; pos < partial_end; ++pos )
         {
@@ -378,7 +380,6 @@ int debug_delay( const std::string & input_filename,
         }
       delete master;
       }
-    delete[] buffer2;
     delete[] mbuffer;
     print_pending_newline( terminator );
     }
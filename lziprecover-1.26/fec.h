@@ -244,7 +244,6 @@ inline void prot_stdin()
 
 // defined in fec_create.cc
 enum { fc_percent, fc_blocks, fc_bytes };
-void cleanup_mutex_lock();
 int gf_check( const unsigned k, const bool cl_gf16, const bool fec_random );
 void extract_dirname( const std::string & name, std::string & srcdir );
 void replace_dirname( const std::string & name, const std::string & srcdir,
@@ -42,73 +42,12 @@
 
 namespace {
 
-void xinit_mutex( pthread_mutex_t * const mutex )
-  {
-  const int errcode = pthread_mutex_init( mutex, 0 );
-  if( errcode )
-    { show_error( "pthread_mutex_init", errcode ); cleanup_and_fail( 1 ); }
-  }
-
-void xinit_cond( pthread_cond_t * const cond )
-  {
-  const int errcode = pthread_cond_init( cond, 0 );
-  if( errcode )
-    { show_error( "pthread_cond_init", errcode ); cleanup_and_fail( 1 ); }
-  }
-
-
-void xdestroy_mutex( pthread_mutex_t * const mutex )
-  {
-  const int errcode = pthread_mutex_destroy( mutex );
-  if( errcode )
-    { show_error( "pthread_mutex_destroy", errcode ); cleanup_and_fail( 1 ); }
-  }
-
-void xdestroy_cond( pthread_cond_t * const cond )
-  {
-  const int errcode = pthread_cond_destroy( cond );
-  if( errcode )
-    { show_error( "pthread_cond_destroy", errcode ); cleanup_and_fail( 1 ); }
-  }
-
-
-void xlock( pthread_mutex_t * const mutex )
-  {
-  const int errcode = pthread_mutex_lock( mutex );
-  if( errcode )
-    { show_error( "pthread_mutex_lock", errcode ); cleanup_and_fail( 1 ); }
-  }
-
-void xunlock( pthread_mutex_t * const mutex )
-  {
-  const int errcode = pthread_mutex_unlock( mutex );
-  if( errcode )
-    { show_error( "pthread_mutex_unlock", errcode ); cleanup_and_fail( 1 ); }
-  }
-
-
-void xwait( pthread_cond_t * const cond, pthread_mutex_t * const mutex )
-  {
-  const int errcode = pthread_cond_wait( cond, mutex );
-  if( errcode )
-    { show_error( "pthread_cond_wait", errcode ); cleanup_and_fail( 1 ); }
-  }
-
-void xsignal( pthread_cond_t * const cond )
-  {
-  const int errcode = pthread_cond_signal( cond );
-  if( errcode )
-    { show_error( "pthread_cond_signal", errcode ); cleanup_and_fail( 1 ); }
-  }
-
-
 unsigned long out_size;		// size of fec data written to outfd
 unsigned deliver_id;		// id of worker writing fec packets to outfd
 unsigned check_counter;
 unsigned wait_counter;
 pthread_mutex_t omutex;
 std::vector< pthread_cond_t > may_deliver;	// worker[i] may write
-pthread_mutex_t cmutex = PTHREAD_MUTEX_INITIALIZER;	// cleanup mutex
 
 
 struct Mworker_arg
@@ -612,9 +551,6 @@ Fec_packet::Fec_packet( const uint8_t * const prodata,
   }
 
 
-void cleanup_mutex_lock()		// make cleanup_and_fail thread-safe
-  { pthread_mutex_lock( &cmutex ); }	// ignore errors to avoid loop
-
 int gf_check( const unsigned k, const bool cl_gf16, const bool fec_random )
   {
   std::vector< unsigned > fbn_vector;
@@ -69,13 +69,14 @@ bool compare_member( const uint8_t * const mbuffer, const long msize,
   }
 
 
-int test_member_rest( const LZ_mtester & master, uint8_t * const buffer2,
+int test_member_rest( const LZ_mtester & master, Trial_buffer & buffer2,
                       long * const failure_posp,
                       const unsigned long long byte_pos )
   {
   LZ_mtester mtester( master );		// tester with external buffer
   mtester.duplicate_buffer( buffer2 );
   int result = mtester.test_member( LONG_MAX, LLONG_MAX, stdout, byte_pos );
+  mtester.set_dirty_size( buffer2, master );
   if( result == 0 && !mtester.finished() ) result = -1;	// false negative
   if( result != 0 ) *failure_posp = mtester.member_position();
   return result;
@@ -141,7 +142,7 @@ int lunzcrash_bit( const std::string & input_filename,
       std::printf( "Testing bytes %s to %s\n",
                    format_num3( mpos + pos ), format_num3( mpos + end - 1 ) );
     LZ_mtester master( mbuffer, msize, dictionary_size );
-    uint8_t * const buffer2 = new uint8_t[dictionary_size];
+    Trial_buffer buffer2( dictionary_size );
     for( ; pos < end; ++pos )
       {
       const long pos_limit = pos - 16;
@@ -200,7 +201,6 @@ int lunzcrash_bit( const std::string & input_filename,
         mbuffer[pos] ^= mask;
         }
       }
-    delete[] buffer2;
     if( !compare_member( mbuffer, msize, dictionary_size, mpos + pos, md5_orig ) )
       internal_error( "Some byte was not properly restored." );
     delete[] mbuffer;
@@ -265,7 +265,7 @@ int lunzcrash_block( const std::string & input_filename,
                    format_num3( sector_size ), format_num3( mpos + pos ),
                    format_num3( mpos + end - 1 ) );
     LZ_mtester master( mbuffer, msize, dictionary_size );
-    uint8_t * const buffer2 = new uint8_t[dictionary_size];
+    Trial_buffer buffer2( dictionary_size );
     for( ; pos < end; ++pos )
       {
       const long pos_limit = pos - 16;
@@ -319,7 +319,6 @@ int lunzcrash_block( const std::string & input_filename,
         }
       std::memcpy( mbuffer + pos, block, sector_size );		// restore block
       }
-    delete[] buffer2;
     if( !compare_member( mbuffer, msize, dictionary_size, mpos + pos, md5_orig ) )
       internal_error( "Block was not properly restored." );
     delete[] mbuffer;
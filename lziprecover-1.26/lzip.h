@@ -15,6 +15,8 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <pthread.h>
+
 #include "common.h"
 
 class State
@@ -503,7 +505,16 @@ bool open_outstream( const bool force, const bool protect,
                      const bool rw = false, const bool skipping = true,
                      const bool to_file = false );
 bool output_file_exists();
+extern pthread_mutex_t cmutex;	// held by cleanup_and_fail
 void cleanup_and_fail( const int retval );
+void xinit_mutex( pthread_mutex_t * const mutex );
+void xinit_cond( pthread_cond_t * const cond );
+void xdestroy_mutex( pthread_mutex_t * const mutex );
+void xdestroy_cond( pthread_cond_t * const cond );
+void xlock( pthread_mutex_t * const mutex );
+void xunlock( pthread_mutex_t * const mutex );
+void xwait( pthread_cond_t * const cond, pthread_mutex_t * const mutex );
+void xsignal( pthread_cond_t * const cond );
 bool check_tty_out();
 void format_trailing_bytes( const uint8_t * const data, const int size,
                             std::string & msg );
@@ -526,8 +537,8 @@ int test_member_from_file( const int infd, const unsigned long long msize,
                            bool * const nonzerop = 0 );
 int merge_files( const std::vector< std::string > & filenames,
                  const std::string & default_output_filename,
-                 const Cl_options & cl_opts, const char terminator,
-                 const bool force );
+                 const Cl_options & cl_opts, const int num_workers,
+                 const char terminator, const bool force );
 
 // defined in nrep_stats.cc
 int print_nrep_stats( const std::vector< std::string > & filenames,
@@ -136,7 +136,7 @@ void show_help( const long num_online )
     "  -D, --range-decompress=<n-m>  decompress a range of bytes to stdout\n"
     "  -e, --reproduce               try to reproduce a zeroed sector in file\n"
     "      --lzip-level=N|a|m[N]     reproduce one level, all, or match length\n"
-    "      --lzip-name=<name>        name of lzip executable for --reproduce\n"
+    "      --lzip-name=<name>        use lzip executable <name> for --reproduce\n"
     "      --reference-file=<file>   reference file for --reproduce\n"
     "  -f, --force                   overwrite existing output files\n"
     "  -F, --fec=c[N]|r|t|l          create, repair, test, list (using) fec file\n"
@@ -146,7 +146,7 @@ void show_help( const long num_online )
     "  -k, --keep                    keep (don't delete) input files\n"
     "  -l, --list                    print (un)compressed file sizes\n"
     "  -m, --merge                   repair errors in file using several copies\n"
-    "  -n, --threads=<n>             set number of threads for fec create [%ld]\n"
+    "  -n, --threads=<n>             set number of threads for fec create, merge [%ld]\n"
     "  -o, --output=<file>[/]        place the output into <file> or directory\n"
     "  -q, --quiet                   suppress all messages\n"
     "  -r, --recursive               (fec) operate recursively on directories\n"
@@ -676,10 +676,12 @@ void set_signals( void (*action)(int) )
   }
 
 
+pthread_mutex_t cmutex = PTHREAD_MUTEX_INITIALIZER;	// cleanup mutex
+
 void cleanup_and_fail( const int retval )
   {
   set_signals( SIG_IGN );			// ignore signals
-  cleanup_mutex_lock();		// only one thread can delete and exit
+  pthread_mutex_lock( &cmutex );	// only one thread can delete and exit
   if( delete_output_on_interrupt )
     {
     delete_output_on_interrupt = false;
@@ -693,6 +695,66 @@ void cleanup_and_fail( const int retval )
   }
 
 
+void xinit_mutex( pthread_mutex_t * const mutex )
+  {
+  const int errcode = pthread_mutex_init( mutex, 0 );
+  if( errcode )
+    { show_error( "pthread_mutex_init", errcode ); cleanup_and_fail( 1 ); }
+  }
+
+void xinit_cond( pthread_cond_t * const cond )
+  {
+  const int errcode = pthread_cond_init( cond, 0 );
+  if( errcode )
+    { show_error( "pthread_cond_init", errcode ); cleanup_and_fail( 1 ); }
+  }
+
+
+void xdestroy_mutex( pthread_mutex_t * const mutex )
+  {
+  const int errcode = pthread_mutex_destroy( mutex );
+  if( errcode )
+    { show_error( "pthread_mutex_destroy", errcode ); cleanup_and_fail( 1 ); }
+  }
+
+void xdestroy_cond( pthread_cond_t * const cond )
+  {
+  const int errcode = pthread_cond_destroy( cond );
+  if( errcode )
+    { show_error( "pthread_cond_destroy", errcode ); cleanup_and_fail( 1 ); }
+  }
+
+
+void xlock( pthread_mutex_t * const mutex )
+  {
+  const int errcode = pthread_mutex_lock( mutex );
+  if( errcode )
+    { show_error( "pthread_mutex_lock", errcode ); cleanup_and_fail( 1 ); }
+  }
+
+void xunlock( pthread_mutex_t * const mutex )
+  {
+  const int errcode = pthread_mutex_unlock( mutex );
+  if( errcode )
+    { show_error( "pthread_mutex_unlock", errcode ); cleanup_and_fail( 1 ); }
+  }
+
+
+void xwait( pthread_cond_t * const cond, pthread_mutex_t * const mutex )
+  {
+  const int errcode = pthread_cond_wait( cond, mutex );
+  if( errcode )
+    { show_error( "pthread_cond_wait", errcode ); cleanup_and_fail( 1 ); }
+  }
+
+void xsignal( pthread_cond_t * const cond )
+  {
+  const int errcode = pthread_cond_signal( cond );
+  if( errcode )
+    { show_error( "pthread_cond_signal", errcode ); cleanup_and_fail( 1 ); }
+  }
+
+
 bool check_tty_out()
   {
   if( isatty( outfd ) )
@@ -953,7 +1015,7 @@ int main( const int argc, const char * const argv[] )
   std::string append_filename;
   std::string cl_fec_filename;
   std::string default_output_filename;
-  const char * lzip_name = "lzip";		// default is lzip
+  const char * lzip_name = 0;		// default is the built-in lzlib
   const char * reference_filename = 0;
   unsigned long fb_or_pct = 8;	// fec blocks, bytes (B), or 0.001% to 100%
   unsigned cblocks = 0;		// blocks per combination in fec_dc
@@ -1206,8 +1268,9 @@ int main( const int argc, const char * const argv[] )
     case m_merge: no_to_stdout( to_stdout );
       if( filenames.size() < 2 )
         { show_error( "You must specify at least 2 files.", 0, true ); return 1; }
+      if( num_workers <= 0 ) num_workers = std::min( num_online, max_workers );
       return merge_files( filenames, default_output_filename, cl_opts,
-                          terminator, force );
+                          num_workers, terminator, force );
     case m_nonzero_repair:
       at_least_one_file( filenames.size() );
       return nonzero_repair( filenames, cl_opts );
@@ -23,15 +23,18 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <new>
 #include <string>
 #include <vector>
 #include <stdint.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
 #include "lzip.h"
 #include "decoder.h"
 #include "lzip_index.h"
+#include "mtester.h"
 
 
 Block Block::split( const long long pos )
@@ -344,13 +347,414 @@ bool color_done( const std::vector< int > & color_vector, const int i )
   }
 
 
-// try dividing blocks in 2 color groups at every gap
-bool try_merge_member2( const std::vector< std::string > & filenames,
-                        const long long mpos, const long long msize,
-                        const std::vector< Block > & block_vector,
-                        const std::vector< int > & color_vector,
-                        const std::vector< int > & infd_vector,
-                        const char terminator )
+/* Decoder state saved before the beginning of a block. It remains valid
+   while the blocks preceding it don't change. */
+class Checkpoint
+  {
+  uint8_t * const buffer;
+  LZ_mtester * const mtester_;
+
+  Checkpoint( const Checkpoint & );		// declared as private
+  void operator=( const Checkpoint & );		// declared as private
+
+public:
+  const unsigned dictionary_size;
+
+  Checkpoint( const LZ_mtester & mtester, const unsigned dict_size )
+    : buffer( new uint8_t[dict_size] ), mtester_( new LZ_mtester( mtester ) ),
+      dictionary_size( dict_size )
+    { mtester_->duplicate_buffer( buffer ); }
+  ~Checkpoint() { delete mtester_; delete[] buffer; }
+
+  const LZ_mtester & mtester() const { return *mtester_; }
+  };
+
+
+/* Member being merged, kept in memory. Each variation is tested resuming
+   the decoding from the checkpoint of the first block changed, instead of
+   decoding the member again from the beginning. */
+class Member_merger
+  {
+  const std::vector< std::string > & filenames;
+  const std::vector< int > & infd_vector;
+  const std::vector< Block > & block_vector;
+  const long long mpos, msize;
+  uint8_t * const mbuffer;
+  std::vector< int > file_idx;		// file copied to each block, or -1
+  std::vector< Checkpoint * > checkpoints;	// state before each block
+  int valid_checkpoints;		// checkpoints[0..valid-1] are valid
+  int max_checkpoints;
+  std::vector< uint8_t > buffer2;	// buffer of the tester being used
+
+  Member_merger( const Member_merger & );	// declared as private
+  void operator=( const Member_merger & );	// declared as private
+
+  bool test_rest( LZ_mtester & mtester, const unsigned dictionary_size,
+                  int bi, long long * const failure_posp );
+
+public:
+  // 'mbuf' contains a copy of the member and is owned by the merger
+  Member_merger( const std::vector< std::string > & fnames,
+                 const std::vector< int > & ifd_vector,
+                 const std::vector< Block > & bvector,
+                 const long long mp, const long long ms, uint8_t * const mbuf,
+                 const unsigned long long checkpoint_memory )
+    : filenames( fnames ), infd_vector( ifd_vector ), block_vector( bvector ),
+      mpos( mp ), msize( ms ), mbuffer( mbuf ),
+      file_idx( bvector.size(), -1 ), checkpoints( bvector.size(), 0 ),
+      valid_checkpoints( 0 )
+    {
+    const Lzip_header & header = *(const Lzip_header *)mbuffer;
+    unsigned dictionary_size = header.dictionary_size();
+    if( !isvalid_ds( dictionary_size ) ) dictionary_size = max_dictionary_size;
+    max_checkpoints = std::max( 1ULL, checkpoint_memory / dictionary_size );
+    }
+
+  ~Member_merger()
+    {
+    for( unsigned i = 0; i < checkpoints.size(); ++i ) delete checkpoints[i];
+    delete[] mbuffer;
+    }
+
+  void copy_block( const int bi, const int fi );
+  bool test( long long * const failure_posp );
+  void write_member() const
+    { if( seek_write( outfd, mbuffer, msize, mpos ) != msize )
+        { show_file_error( printable_name( output_filename, false ),
+                           wr_err_msg, errno ); cleanup_and_fail( 1 ); } }
+  };
+
+
+// copy block 'bi' from file 'fi' to mbuffer
+void Member_merger::copy_block( const int bi, const int fi )
+  {
+  if( file_idx[bi] == fi ) return;
+  const Block & b = block_vector[bi];
+  xlock( &cmutex );		// serializes seek + read, see cleanup_and_fail
+  if( !safe_seek( infd_vector[fi], b.pos(), filenames[fi] ) )
+    { xunlock( &cmutex ); cleanup_and_fail( 1 ); }
+  if( readblock( infd_vector[fi], mbuffer + ( b.pos() - mpos ), b.size() ) !=
+      b.size() )
+    { show_file_error( printable_name( filenames[fi] ), rd_err_msg, errno );
+      xunlock( &cmutex ); cleanup_and_fail( 1 ); }
+  xunlock( &cmutex );
+  file_idx[bi] = fi;
+  if( valid_checkpoints > bi + 1 ) valid_checkpoints = bi + 1;
+  }
+
+
+/* Decode the rest of the member starting before block 'bi', saving a
+   checkpoint before each block not yet decoded. */
+bool Member_merger::test_rest( LZ_mtester & mtester,
+                               const unsigned dictionary_size, int bi,
+                               long long * const failure_posp )
+  {
+  const int blocks = block_vector.size();
+  int ret = -1;
+  for( ; bi < blocks && ret == -1; ++bi )
+    {
+    // same safety margin as used by byte_repair for the master
+    const long long pos_limit = block_vector[bi].pos() - mpos - 16;
+    if( pos_limit >= Lzip_header::size && bi < max_checkpoints )
+      {
+      ret = mtester.test_member( pos_limit );
+      if( ret != -1 ) break;
+      delete checkpoints[bi];
+      checkpoints[bi] = new Checkpoint( mtester, dictionary_size );
+      }
+    valid_checkpoints = bi + 1;
+    }
+  if( ret == -1 ) ret = mtester.test_member();
+  if( ret == 0 && mtester.finished() ) return true;
+  if( failure_posp ) *failure_posp = mtester.member_position();
+  return false;
+  }
+
+
+// test the member as currently merged in mbuffer
+bool Member_merger::test( long long * const failure_posp )
+  {
+  int bi = valid_checkpoints;
+  while( --bi >= 0 && !checkpoints[bi] ) {}
+  if( bi >= 0 )				// resume from checkpoint
+    {
+    const Checkpoint & cp = *checkpoints[bi];
+    if( buffer2.size() < cp.dictionary_size )
+      buffer2.resize( cp.dictionary_size );
+    LZ_mtester mtester( cp.mtester() );	// tester with external buffer
+    mtester.duplicate_buffer( &buffer2[0] );
+    return test_rest( mtester, cp.dictionary_size, bi + 1, failure_posp );
+    }
+  const Lzip_header & header = *(const Lzip_header *)mbuffer;
+  const unsigned dictionary_size = header.dictionary_size();
+  if( msize < min_member_size || !header.check_magic() ||
+      !header.check_version() || !isvalid_ds( dictionary_size ) )
+    { if( failure_posp ) *failure_posp = 0; return false; }
+  LZ_mtester mtester( mbuffer, msize, dictionary_size );
+  return test_rest( mtester, dictionary_size, 0, failure_posp );
+  }
+
+
+/* Variations are grouped in chunks numbered in the order in which they
+   would be tried serially. Worker threads take the chunks in order and
+   stop at the first valid member found in the lowest chunk, so the result
+   is the same as trying all the variations serially. */
+struct Merge_search
+  {
+  const std::vector< std::string > & filenames;
+  const std::vector< Block > & block_vector;
+  const std::vector< int > & color_vector;
+  const std::vector< int > & infd_vector;
+  const long long mpos;
+  const long long msize;
+  int num_workers;			// reduced if not enough memory
+  const char terminator;
+  const bool by_gaps;			// try_merge_member2 or try_merge_member
+  std::vector< int > good_files;	// files not identical to a previous one
+  int prefix_blocks;			// blocks defining a chunk (by_gaps = 0)
+  long chunks;
+  long variations;
+  pthread_mutex_t mutex;		// protects the members below
+  long next_chunk;			// next chunk to be tried
+  long found_chunk;			// lowest chunk with a valid member
+  Member_merger * winner;		// merger containing the valid member
+
+  Merge_search( const std::vector< std::string > & fnames,
+                const std::vector< Block > & bvector,
+                const std::vector< int > & cvector,
+                const std::vector< int > & ifd_vector,
+                const long long mp, const long long ms, const int workers,
+                const char t, const bool gaps )
+    : filenames( fnames ), block_vector( bvector ), color_vector( cvector ),
+      infd_vector( ifd_vector ), mpos( mp ), msize( ms ),
+      num_workers( workers ), terminator( t ), by_gaps( gaps ),
+      prefix_blocks( 0 ), next_chunk( 0 ), found_chunk( LONG_MAX ),
+      winner( 0 )
+    { xinit_mutex( &mutex ); }
+  ~Merge_search() { delete winner; xdestroy_mutex( &mutex ); }
+
+  bool chunk_is_useless( const long chunk )
+    { xlock( &mutex ); const bool useless = found_chunk < chunk;
+      xunlock( &mutex ); return useless; }
+  void print_variation( const long var, const int bi = 0 );
+
+  bool try_chunk_by_gaps( Member_merger & merger, const long chunk );
+  bool try_chunk( Member_merger & merger, const long chunk );
+  bool search();
+  };
+
+
+// format_num3 is not thread-safe; it is called with 'mutex' locked
+void Merge_search::print_variation( const long var, const int bi )
+  {
+  xlock( &mutex );
+  if( by_gaps )
+    std::printf( "  Trying variation %ld of %ld, block %d        %c",
+                 var, variations, bi + 1, terminator );
+  else
+    std::printf( "  Trying variation %s of %s %c", format_num3( var ),
+                 format_num3( variations ), terminator );
+  std::fflush( stdout ); pending_newline = true;
+  xunlock( &mutex );
+  }
+
+
+// try dividing blocks in 2 color groups at the gaps after block 'bi'
+bool Merge_search::try_chunk_by_gaps( Member_merger & merger, const long chunk )
+  {
+  const int blocks = block_vector.size();
+  const int files = infd_vector.size();
+  const int i1 = chunk / files;
+  const int i2 = chunk % files;
+  if( i1 == i2 || color_vector[i1] == color_vector[i2] ||
+      color_done( color_vector, i1 ) ) return false;
+  for( int bi = 0; bi < blocks; ++bi ) merger.copy_block( bi, i2 );
+  const int var = ( i1 * ( files - 1 ) ) + i2 - ( i2 > i1 ) + 1;
+  for( int bi = 0; bi + 1 < blocks; ++bi )
+    {
+    if( chunk_is_useless( chunk ) ) return false;
+    if( verbosity >= 2 ) print_variation( var, bi );
+    merger.copy_block( bi, i1 );
+    long long failure_pos = 0;
+    if( merger.test( &failure_pos ) ) return true;
+    if( mpos + failure_pos < block_vector[bi].end() ) break;
+    }
+  return false;
+  }
+
+
+// try all the variations whose first 'prefix_blocks' blocks form 'chunk'
+bool Merge_search::try_chunk( Member_merger & merger, const long chunk )
+  {
+  const int blocks = block_vector.size();
+  const int files = infd_vector.size();
+  const int good = good_files.size();
+  std::vector< int > file_idx( blocks, 0 );	// file to read each block from
+  long c = chunk;
+  for( int i = prefix_blocks - 1; i >= 0; --i )
+    { file_idx[i] = good_files[c % good]; c /= good; }
+  int bi = 0;					// block index
+
+  do {
+    if( chunk_is_useless( chunk ) ) return false;
+    if( verbosity >= 2 )
+      {
+      long var = 0;
+      for( int i = 0; i < blocks; ++i ) var = var * files + file_idx[i];
+      print_variation( var + 1 );
+      }
+    for( ; bi < blocks; ++bi ) merger.copy_block( bi, file_idx[bi] );
+    long long failure_pos = 0;
+    if( merger.test( &failure_pos ) ) return true;
+    while( bi > 0 && mpos + failure_pos < block_vector[bi-1].pos() ) --bi;
+    while( --bi >= prefix_blocks )
+      {
+      while( ++file_idx[bi] < files &&
+             color_done( color_vector, file_idx[bi] ) );
+      if( file_idx[bi] < files ) break;
+      file_idx[bi] = 0;
+      }
+    } while( bi >= prefix_blocks );
+  return false;
+  }
+
+
+struct Merge_arg
+  {
+  Merge_search * ms;
+  Member_merger * merger;
+  };
+
+extern "C" void * merge_worker( void * arg )
+  {
+  const Merge_arg & tmp = *(const Merge_arg *)arg;
+  Merge_search & ms = *tmp.ms;
+  Member_merger * merger = tmp.merger;
+  try {
+  while( true )
+    {
+    xlock( &ms.mutex );
+    const long chunk = ms.next_chunk++;
+    const bool done = chunk >= ms.chunks || chunk > ms.found_chunk;
+    xunlock( &ms.mutex );
+    if( done ) break;
+    if( ms.by_gaps ? ms.try_chunk_by_gaps( *merger, chunk ) :
+                     ms.try_chunk( *merger, chunk ) )
+      {
+      xlock( &ms.mutex );
+      if( chunk < ms.found_chunk )
+        { ms.found_chunk = chunk; std::swap( ms.winner, merger ); }
+      xunlock( &ms.mutex );
+      break;
+      }
+    }
+  }
+  catch( std::bad_alloc & ) { show_error( mem_msg ); cleanup_and_fail( 1 ); }
+  delete merger;
+  return 0;
+  }
+
+
+/* Return a copy of the member read from outfd, or 0 if there is not
+   enough memory. */
+uint8_t * read_output_member( const long long mpos, const long long msize )
+  {
+  uint8_t * const buffer = new( std::nothrow ) uint8_t[msize];
+  if( !buffer ) return 0;
+  xlock( &cmutex );				// because of cleanup_and_fail
+  if( !safe_seek( outfd, mpos, output_filename ) )
+    { xunlock( &cmutex ); cleanup_and_fail( 1 ); }
+  if( readblock( outfd, buffer, msize ) != msize )
+    { show_file_error( printable_name( output_filename, false ), rd_err_msg,
+                       errno ); xunlock( &cmutex ); cleanup_and_fail( 1 ); }
+  xunlock( &cmutex );
+  return buffer;
+  }
+
+
+// Return false if the member does not fit in memory.
+bool Merge_search::search()
+  {
+  const int blocks = block_vector.size();
+  const int files = infd_vector.size();
+  if( msize > LONG_MAX || !fits_in_size_t( msize ) ) return false;
+  uint8_t * const mbuffer = read_output_member( mpos, msize );
+  if( !mbuffer ) return false;
+
+  /* Each merger uses a copy of the member plus two dictionaries. Limit the
+     number of mergers so that they use at most half the RAM, and give the
+     rest, up to 1 GiB, to the checkpoints. */
+  const Lzip_header & header = *(const Lzip_header *)mbuffer;
+  unsigned dictionary_size = header.dictionary_size();
+  if( !isvalid_ds( dictionary_size ) ) dictionary_size = min_dictionary_size;
+  const unsigned long long merger_size = msize + 2ULL * dictionary_size;
+  const long page_size = sysconf( _SC_PAGESIZE );
+  const long pages = sysconf( _SC_PHYS_PAGES );
+  const unsigned long long max_memory =
+    ( ( page_size > 1 && pages > 1 && LLONG_MAX / page_size >= pages ) ?
+      (unsigned long long)page_size * pages : ULLONG_MAX ) / 2;
+  if( num_workers > 1 && max_memory / merger_size < (unsigned)num_workers )
+    num_workers = std::max( 1ULL, max_memory / merger_size );
+  std::vector< uint8_t * > buffers( 1, mbuffer );
+  while( (int)buffers.size() < num_workers )
+    {
+    uint8_t * const buffer = new( std::nothrow ) uint8_t[msize];
+    if( !buffer ) break;
+    std::memcpy( buffer, mbuffer, msize );
+    buffers.push_back( buffer );
+    }
+  num_workers = buffers.size();
+  const unsigned long long used_memory = num_workers * merger_size;
+  const unsigned long long checkpoint_memory = ( max_memory > used_memory ) ?
+    std::min( max_memory - used_memory, 1ULL << 30 ) / num_workers : 0;
+  std::vector< Merge_arg > merge_args( num_workers );
+  for( int i = 0; i < num_workers; ++i )
+    {
+    merge_args[i].ms = this;
+    merge_args[i].merger = new Member_merger( filenames, infd_vector,
+      block_vector, mpos, msize, buffers[i], checkpoint_memory );
+    }
+
+  if( by_gaps ) { chunks = files * files; variations = files * ( files - 1 ); }
+  else
+    {
+    for( int i = 0; i < files; ++i )
+      if( !color_done( color_vector, i ) ) good_files.push_back( i );
+    // use enough chunks to keep all the workers busy
+    chunks = 1;
+    while( prefix_blocks < blocks && chunks < 4 * num_workers )
+      { chunks *= good_files.size(); ++prefix_blocks; }
+    variations = ipow( files, blocks );
+    }
+  std::vector< pthread_t > worker_threads( num_workers );
+  int running = 0;			// number of worker threads created
+  if( num_workers > 1 )
+    for( ; running < num_workers; ++running )
+      if( pthread_create( &worker_threads[running], 0, merge_worker,
+                          &merge_args[running] ) != 0 ) break;
+  if( running < num_workers )	// continue with the threads created, if any
+    {
+    for( int i = std::max( running, 1 ); i < num_workers; ++i )
+      delete merge_args[i].merger;
+    if( running == 0 ) merge_worker( &merge_args[0] );
+    }
+  for( int i = 0; i < running; ++i )
+    {
+    const int errcode = pthread_join( worker_threads[i], 0 );
+    if( errcode ) { show_error( "Can't join worker threads", errcode );
+                    cleanup_and_fail( 1 ); }
+    }
+  return true;
+  }
+
+
+// try dividing blocks in 2 color groups at every gap, testing from file
+bool stream_merge_member2( const std::vector< std::string > & filenames,
+                           const long long mpos, const long long msize,
+                           const std::vector< Block > & block_vector,
+                           const std::vector< int > & color_vector,
+                           const std::vector< int > & infd_vector,
+                           const char terminator )
   {
   const int blocks = block_vector.size();
   const int files = infd_vector.size();
@@ -392,25 +796,17 @@ bool try_merge_member2( const std::vector< std::string > & filenames,
   }
 
 
-// merge block by block
-bool try_merge_member( const std::vector< std::string > & filenames,
-                       const long long mpos, const long long msize,
-                       const std::vector< Block > & block_vector,
-                       const std::vector< int > & color_vector,
-                       const std::vector< int > & infd_vector,
-                       const char terminator )
+// merge block by block, testing from file
+bool stream_merge_member( const std::vector< std::string > & filenames,
+                          const long long mpos, const long long msize,
+                          const std::vector< Block > & block_vector,
+                          const std::vector< int > & color_vector,
+                          const std::vector< int > & infd_vector,
+                          const char terminator )
   {
   const int blocks = block_vector.size();
   const int files = infd_vector.size();
   const long variations = ipow( files, blocks );
-  if( variations >= LONG_MAX )
-    {
-    if( files > 2 )
-      show_error( "Too many damaged blocks. Try merging fewer files." );
-    else
-      show_error( "Too many damaged blocks. Merging is not possible." );
-    cleanup_and_fail( 2 );
-    }
   int bi = 0;					// block index
   std::vector< int > file_idx( blocks, 0 );	// file to read each block from
 
@@ -449,6 +845,54 @@ bool try_merge_member( const std::vector< std::string > & filenames,
   }
 
 
+// try dividing blocks in 2 color groups at every gap
+bool try_merge_member2( const std::vector< std::string > & filenames,
+                        const long long mpos, const long long msize,
+                        const std::vector< Block > & block_vector,
+                        const std::vector< int > & color_vector,
+                        const std::vector< int > & infd_vector,
+                        const int num_workers, const char terminator )
+  {
+  Merge_search ms( filenames, block_vector, color_vector, infd_vector, mpos,
+                   msize, num_workers, terminator, true );
+  if( !ms.search() )				// member too large
+    return stream_merge_member2( filenames, mpos, msize, block_vector,
+                                 color_vector, infd_vector, terminator );
+  if( !ms.winner ) return false;
+  ms.winner->write_member();
+  return true;
+  }
+
+
+// merge block by block
+bool try_merge_member( const std::vector< std::string > & filenames,
+                       const long long mpos, const long long msize,
+                       const std::vector< Block > & block_vector,
+                       const std::vector< int > & color_vector,
+                       const std::vector< int > & infd_vector,
+                       const int num_workers, const char terminator )
+  {
+  const int blocks = block_vector.size();
+  const int files = infd_vector.size();
+  if( ipow( files, blocks ) >= LONG_MAX )
+    {
+    if( files > 2 )
+      show_error( "Too many damaged blocks. Try merging fewer files." );
+    else
+      show_error( "Too many damaged blocks. Merging is not possible." );
+    cleanup_and_fail( 2 );
+    }
+  Merge_search ms( filenames, block_vector, color_vector, infd_vector, mpos,
+                   msize, num_workers, terminator, false );
+  if( !ms.search() )				// member too large
+    return stream_merge_member( filenames, mpos, msize, block_vector,
+                                color_vector, infd_vector, terminator );
+  if( !ms.winner ) return false;
+  ms.winner->write_member();
+  return true;
+  }
+
+
 // merge a single block split at every possible position
 bool try_merge_member1( const std::vector< std::string > & filenames,
                         const long long mpos, const long long msize,
@@ -568,8 +1012,8 @@ int test_member_from_file( const int infd, const unsigned long long msize,
 
 int merge_files( const std::vector< std::string > & filenames,
                  const std::string & default_output_filename,
-                 const Cl_options & cl_opts, const char terminator,
-                 const bool force )
+                 const Cl_options & cl_opts, const int num_workers,
+                 const char terminator, const bool force )
   {
   const int files = filenames.size();
   std::vector< int > infd_vector( files );
@@ -624,14 +1068,16 @@ int merge_files( const std::vector< std::string > & filenames,
       {
       maybe_cluster_blocks( block_vector );
       done = try_merge_member2( filenames, mpos, msize, block_vector,
-                                color_vector, infd_vector, terminator );
+                                color_vector, infd_vector, num_workers,
+                                terminator );
       print_pending_newline( terminator );
       }
     // With just one member and one differing block the merge can't succeed.
     if( !done && ( lzip_index.members() > 1 || block_vector.size() > 1 ) )
       {
       done = try_merge_member( filenames, mpos, msize, block_vector,
-                               color_vector, infd_vector, terminator );
+                               color_vector, infd_vector, num_workers,
+                               terminator );
       print_pending_newline( terminator );
       }
     if( !done )
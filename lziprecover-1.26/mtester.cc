@@ -78,6 +78,32 @@ void LZ_mtester::duplicate_buffer( uint8_t * const buffer2 )
   }
 
 
+/* If tb already contains the buffer of the master, copy only the bytes
+   written since then by the last trial and by the master. Both wrote them
+   starting at the position of the master in the last trial. */
+void LZ_mtester::duplicate_buffer( Trial_buffer & tb )
+  {
+  const unsigned long long dpos = data_position();
+  const unsigned long long advance = dpos - tb.master_pos;
+  const unsigned long long size = std::max( tb.dirty_size, advance );
+  if( !tb.valid || dpos < tb.master_pos || size >= dictionary_size )
+    duplicate_buffer( tb.data );
+  else
+    {
+    const unsigned start =
+      ( pos >= advance ) ? pos - advance : pos + dictionary_size - advance;
+    const unsigned size1 = std::min( (unsigned)size, dictionary_size - start );
+    std::memcpy( tb.data + start, buffer + start, size1 );
+    std::memcpy( tb.data, buffer, size - size1 );	// wrapped part
+    buffer = tb.data;
+    buffer_is_external = true;
+    }
+  tb.master_pos = dpos;
+  tb.dirty_size = 0;
+  tb.valid = true;
+  }
+
+
 void LZ_mtester::flush_data()
   {
   if( pos > stream_pos )
@@ -85,6 +111,9 @@ void LZ_mtester::flush_data()
     const int size = pos - stream_pos;
     crc32.update_buf( crc_, buffer + stream_pos, size );
     if( md5sum ) md5sum->md5_update( buffer + stream_pos, size );
+    if( outbuf )
+      std::memcpy( outbuf + partial_data_pos + stream_pos, buffer + stream_pos,
+                   size );
     if( outfd >= 0 && writeblock( outfd, buffer + stream_pos, size ) != size )
       throw Error( wr_err_msg );
     if( pos >= dictionary_size )
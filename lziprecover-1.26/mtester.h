@@ -237,6 +237,28 @@ len3:
 
 class MD5SUM;		// forward declaration
 
+/* External buffer for the trials of a master LZ_mtester. Between trials
+   of the same master only the bytes written by the last trial, or by the
+   master if it has advanced, need to be copied again from the master. */
+struct Trial_buffer
+  {
+  uint8_t * const data;
+  unsigned long long master_pos;	// data position of master in data
+  unsigned long long dirty_size;	// bytes written by the last trial
+  bool valid;				// data contains the buffer of master
+
+  explicit Trial_buffer( const unsigned dictionary_size )
+    : data( new uint8_t[dictionary_size] ), master_pos( 0 ), dirty_size( 0 ),
+      valid( false ) {}
+  ~Trial_buffer() { delete[] data; }
+
+  void reset() { valid = false; }	// call when the master is replaced
+
+private:
+  Trial_buffer( const Trial_buffer & );		// declared as private
+  void operator=( const Trial_buffer & );	// declared as private
+  };
+
 class LZ_mtester
   {
   unsigned long long partial_data_pos;
@@ -247,6 +269,7 @@ class LZ_mtester
   unsigned stream_pos;		// first byte not yet written to file
   uint32_t crc_;
   const int outfd;		// output file descriptor
+  uint8_t * const outbuf;	// if not null, copy decoded data here
   unsigned dis0;		// dis[0-3] latest four distances
   unsigned dis1;		// used for efficient coding of
   unsigned dis2;		// repeated distances
@@ -341,7 +364,7 @@ void set_max_marker( const unsigned new_size )
 public:
   LZ_mtester( const uint8_t * const ibuf, const long ibuf_size,
               const unsigned dict_size, const int ofd = -1,
-              MD5SUM * const md5sum_ = 0 )
+              MD5SUM * const md5sum_ = 0, uint8_t * const obuf = 0 )
     :
     partial_data_pos( 0 ),
     rdec( ibuf, ibuf_size ),
@@ -351,6 +374,7 @@ public:
     stream_pos( 0 ),
     crc_( 0xFFFFFFFFU ),
     outfd( ofd ),
+    outbuf( obuf ),
     dis0( 0 ),
     dis1( 0 ),
     dis2( 0 ),
@@ -385,6 +409,10 @@ public:
       *prev_bufferp = buffer + pos; return buffer; }
 
   void duplicate_buffer( uint8_t * const buffer2 );
+  void duplicate_buffer( Trial_buffer & tb );
+  // call on the tester after a trial, passing the master it was copied from
+  void set_dirty_size( Trial_buffer & tb, const LZ_mtester & master ) const
+    { tb.dirty_size = data_position() - master.data_position(); }
 
   // these two functions set max_dis0
   int test_member( const unsigned long mpos_limit = LONG_MAX,
@@ -32,6 +32,7 @@
 #include <sys/wait.h>
 
 #include "lzip.h"
+#include "lzlib.h"
 #include "md5.h"
 #include "mtester.h"
 #include "lzip_index.h"
@@ -311,6 +312,187 @@ bool feed_data( uint8_t * const mbuffer, const long msize,
   }
 
 
+/* Decompress the 'good_dsize' bytes preceding the zeroed sector.
+   Return a buffer containing them, or 0 if error. If the prefix is larger
+   than half the RAM or can't be allocated, set 'too_large' and return 0. */
+uint8_t * decode_prefix( const uint8_t * const mbuffer, const long msize,
+                         const unsigned long long good_dsize,
+                         const unsigned dictionary_size, bool & too_large )
+  {
+  const long page_size = sysconf( _SC_PAGESIZE );
+  const long pages = sysconf( _SC_PHYS_PAGES );
+  const unsigned long long ram_size = ( page_size > 1 && pages > 1 ) ?
+    (unsigned long long)page_size * pages : ULLONG_MAX;
+  // test_member may decode a whole packet past dpos_limit
+  const unsigned long long prefix_size = good_dsize + max_match_len;
+  too_large = prefix_size > ram_size / 2 || !fits_in_size_t( prefix_size );
+  if( too_large ) return 0;
+  uint8_t * const prefix = new( std::nothrow ) uint8_t[prefix_size];
+  if( !prefix ) { too_large = true; return 0; }
+  LZ_mtester mtester( mbuffer, msize, dictionary_size, -1, 0, prefix );
+  if( mtester.test_member( LONG_MAX, good_dsize ) != -1 ||
+      good_dsize != mtester.data_position() )
+    { show_error( "Error decompressing prefix data for compressor." );
+      delete[] prefix; return 0; }
+  return prefix;
+  }
+
+
+/* Compare the compressed member being reproduced with mbuffer, and copy
+   into mbuffer the reproduced bytes of the zeroed sector.
+   Return value: -1 = mismatch, 0 = match so far, 1 = done. */
+class Reproduced_comparer
+  {
+  uint8_t * const mbuffer;
+  const long begin, end, xend;
+  const unsigned dictionary_size;
+  const char terminator;
+  long i;				// position in member
+  bool first_post;
+
+public:
+  bool same_ds;				// reproduced DS == header DS
+  bool tail_mismatch;			// mismatch after end
+
+  Reproduced_comparer( uint8_t * const mbuf, const long msize,
+                       const long b, const long e, const unsigned dict_size,
+                       const char t )
+    : mbuffer( mbuf ), begin( b ), end( e ), xend( std::min( e + 4, msize ) ),
+      dictionary_size( dict_size ), terminator( t ), i( 0 ),
+      first_post( true ), same_ds( true ), tail_mismatch( false ) {}
+  void end_post() const
+    { if( !first_post && terminator ) print_pending_newline( terminator ); }
+
+  bool finished() const { return i >= xend; }
+  // not enough reference data to fill zeroed sector at this level
+  int at_eof() const { return ( i < end ) ? -1 : 1; }
+
+  int compare( const uint8_t * const buffer, const int rd )
+    {
+    if( verbosity >= 2 && i >= 65536 && terminator )
+      {
+      if( first_post )
+        { first_post = false; print_pending_newline( terminator ); }
+      std::printf( "  Reproducing position %s %c", format_num3( i ), terminator );
+      std::fflush( stdout ); pending_newline = true;
+      }
+    int j = 0;
+    /* Compare reproduced bytes with data in mbuffer.
+       Do not fail because of a mismatch beyond the end of the zeroed sector
+       to prevent the reproduction from failing because of the reference file
+       just covering the zeroed sector. */
+    for( ; j < rd && i < begin; ++j, ++i )
+      if( mbuffer[i] != buffer[j] )			// mismatch
+        {
+        if( i != 5 ) return -1;				// ignore different DS
+        const Lzip_header * header = (const Lzip_header *)buffer;
+        if( header->dictionary_size() != dictionary_size ) same_ds = false;
+        }
+    // copy reproduced bytes into zeroed sector of mbuffer
+    for( ; j < rd && i < end; ++j, ++i ) mbuffer[i] = buffer[j];
+    for( ; j < rd && i < xend; ++j, ++i )
+      if( mbuffer[i] != buffer[j] ) { tail_mismatch = true; return 1; }
+    return finished();
+    }
+  };
+
+
+/* Test whole member after reproduction.
+   Return value: -1 = failure, 0 = success. */
+int test_reproduced( const uint8_t * const mbuffer, const long msize,
+                     const long begin, const unsigned dictionary_size,
+                     const Reproduced_comparer & rc, MD5SUM * const md5sump,
+                     const char terminator )
+  {
+  if( md5sump ) md5sump->reset();
+  LZ_mtester mtester( mbuffer, msize, dictionary_size, -1, md5sump );
+  if( mtester.test_member() == 0 && mtester.finished() ) return 0;
+  if( verbosity >= 2 && rc.same_ds && begin >= 4096 && terminator )
+    {
+    if( !rc.tail_mismatch )
+      final_msg = "  Zeroed sector reproduced, but CRC does not match."
+                  " (Multiple damages in file?).\n";
+    else if( !final_msg )
+      final_msg = "  Zeroed sector reproduced, but data after it does not"
+                  " match. (Maybe wrong reference data or lzip version).\n";
+    }
+  return -1;			// incorrect reproduction of zeroed sector
+  }
+
+
+/* Try to reproduce the zeroed sector compressing in-process with lzlib the
+   data decompressed up to 'good_dsize' (prefix) followed by the reference
+   data from byte at offset 'offset' of reference file, up to a total of
+   'dsize' bytes. Compression stops at the first mismatch.
+   Return value: -1 = failure, 0 = success, > 0 = fatal error. */
+int try_reproduce_lzlib( uint8_t * const mbuffer, const long msize,
+                         const long long dsize,
+                         const unsigned long long good_dsize,
+                         const long begin, const long end,
+                         const uint8_t * const rbuf, const long rsize,
+                         const long offset, const unsigned dictionary_size,
+                         const uint8_t * const prefix, const int dict_size,
+                         const int match_len_limit, MD5SUM * const md5sump,
+                         const char terminator )
+  {
+  LZ_Encoder * const encoder =
+    LZ_compress_open( dict_size, match_len_limit, 0x0008000000000000ULL );
+  if( !encoder || LZ_compress_errno( encoder ) != LZ_ok )
+    {
+    if( !encoder || LZ_compress_errno( encoder ) == LZ_mem_error )
+      show_error( mem_msg );
+    else internal_error( "invalid argument to encoder." );
+    LZ_compress_close( encoder ); return fatal( 1 );
+    }
+  // limit reference data to remaining decompressed data in member
+  const unsigned long long in_size = good_dsize +
+    std::min( (unsigned long long)rsize - offset, dsize - good_dsize );
+  unsigned long long in_pos = 0;	// data written to encoder
+  int retval = 0;			// -1 = mismatch
+  Reproduced_comparer rc( mbuffer, msize, begin, end, dictionary_size,
+                          terminator );
+  while( true )
+    {
+    while( in_pos < in_size )
+      {
+      const uint8_t * const p = ( in_pos < good_dsize ) ? prefix + in_pos :
+                                rbuf + offset + ( in_pos - good_dsize );
+      const unsigned long long rest = ( ( in_pos < good_dsize ) ?
+                                        good_dsize : in_size ) - in_pos;
+      const int size = std::min( (unsigned long long)
+                                 LZ_compress_write_size( encoder ), rest );
+      if( size <= 0 ) break;
+      const int wr = LZ_compress_write( encoder, p, size );
+      if( wr < 0 ) { retval = 1; break; }
+      in_pos += wr;
+      if( in_pos >= in_size ) LZ_compress_finish( encoder );
+      if( wr < size ) break;
+      }
+    if( retval ) break;
+    enum { buffer_size = 65536 };
+    uint8_t buffer[buffer_size];
+    const int rd = LZ_compress_read( encoder, buffer, buffer_size );
+    if( rd < 0 ) { retval = 1; break; }
+    if( rd == 0 )
+      { if( LZ_compress_finished( encoder ) == 1 )
+          { if( rc.at_eof() < 0 ) retval = -1; break; }
+        continue; }
+    const int ret = rc.compare( buffer, rd );
+    if( ret < 0 ) { retval = -1; break; }
+    if( ret > 0 ) break;
+    }
+  rc.end_post();
+  if( retval > 0 )
+    { show_error( LZ_strerror( LZ_compress_errno( encoder ) ) );
+      retval = fatal( 1 ); }
+  LZ_compress_close( encoder );
+  if( retval == 0 )
+    retval = test_reproduced( mbuffer, msize, begin, dictionary_size, rc,
+                              md5sump, terminator );
+  return retval;
+  }
+
+
 /* Try to reproduce the zeroed sector.
    Return value: -1 = failure, 0 = success, > 0 = fatal error. */
 int try_reproduce( uint8_t * const mbuffer, const long msize,
@@ -355,72 +537,33 @@ int try_reproduce( uint8_t * const mbuffer, const long msize,
     { show_fork_error( lzip_argv[0] ); return fatal( 1 ); }
 
   close( fda[0] ); close( fda[1] ); close( fda2[1] );
-  const long xend = std::min( end + 4, msize );
   int retval = 0;				// -1 = mismatch
-  bool first_post = true;
-  bool same_ds = true;				// reproduced DS == header DS
-  bool tail_mismatch = false;			// mismatch after end
-  for( long i = 0; i < xend; )
+  Reproduced_comparer rc( mbuffer, msize, begin, end, dictionary_size,
+                          terminator );
+  while( !rc.finished() )
     {
     enum { buffer_size = 16384 };		// 65536 makes it slower
     uint8_t buffer[buffer_size];
-    if( verbosity >= 2 && i >= 65536 && terminator )
-      {
-      if( first_post )
-        { first_post = false; print_pending_newline( terminator ); }
-      std::printf( "  Reproducing position %s %c", format_num3( i ), terminator );
-      std::fflush( stdout ); pending_newline = true;
-      }
     const int rd = readblock( fda2[0], buffer, buffer_size );
-    // not enough reference data to fill zeroed sector at this level
-    if( rd <= 0 ) { if( i < end ) retval = -1; break; }
-    int j = 0;
-    /* Compare reproduced bytes with data in mbuffer.
-       Do not fail because of a mismatch beyond the end of the zeroed sector
-       to prevent the reproduction from failing because of the reference file
-       just covering the zeroed sector. */
-    for( ; j < rd && i < begin; ++j, ++i )
-      if( mbuffer[i] != buffer[j] )			// mismatch
-        {
-        if( i != 5 ) { retval = -1; goto done; }	// ignore different DS
-        const Lzip_header * header = (const Lzip_header *)buffer;
-        if( header->dictionary_size() != dictionary_size ) same_ds = false;
-        }
-    // copy reproduced bytes into zeroed sector of mbuffer
-    for( ; j < rd && i < end; ++j, ++i ) mbuffer[i] = buffer[j];
-    for( ; j < rd && i < xend; ++j, ++i )
-      if( mbuffer[i] != buffer[j] ) { tail_mismatch = true; goto done; }
+    if( rd <= 0 ) { if( rc.at_eof() < 0 ) retval = -1; break; }
+    const int ret = rc.compare( buffer, rd );
+    if( ret < 0 ) { retval = -1; break; }
+    if( ret > 0 ) break;
     }
-done:
-  if( !first_post && terminator ) print_pending_newline( terminator );
+  rc.end_post();
   if( close( fda2[0] ) != 0 ) { show_close_error( "compressor" ); retval = 1; }
   if( !good_status( pid, "data feeder", false ) ||
       !good_status( pid2, lzip_argv[0], false ) ) retval = auto0 ? -1 : 1;
   if( retval == 0 )		// test whole member after reproduction
-    {
-    if( md5sump ) md5sump->reset();
-    LZ_mtester mtester( mbuffer, msize, dictionary_size, -1, md5sump );
-    if( mtester.test_member() != 0 || !mtester.finished() )
-      {
-      if( verbosity >= 2 && same_ds && begin >= 4096 && terminator )
-        {
-        if( !tail_mismatch )
-          final_msg = "  Zeroed sector reproduced, but CRC does not match."
-                      " (Multiple damages in file?).\n";
-        else if( !final_msg )
-          final_msg = "  Zeroed sector reproduced, but data after it does not"
-                      " match. (Maybe wrong reference data or lzip version).\n";
-        }
-      retval = -1;		// incorrect reproduction of zeroed sector
-      }
-    }
+    retval = test_reproduced( mbuffer, msize, begin, dictionary_size, rc,
+                              md5sump, terminator );
   return retval;
   }
 
 
 // Return value: -1 = master failed, 0 = success, > 0 = failure
 int reproduce_member( uint8_t * const mbuffer, const long msize,
-                      const long long dsize, const char * const lzip_name,
+                      const long long dsize, const char * lzip_name,
                       const char * const reference_filename, const long begin,
                       const long size, const int lzip_level,
                       MD5SUM * const md5sump, const char terminator )
@@ -462,14 +605,33 @@ int reproduce_member( uint8_t * const mbuffer, const long msize,
       delete master; return 2; }
 
   const unsigned long long good_dsize = master->data_position();
+  delete master;
   const long end = begin + size;
+  /* Without lzip_name, compress in-process with lzlib. The prefix data are
+     decompressed only once for all the levels tried. If they don't fit in
+     memory, stream them to lzip instead, as done with lzip_name. */
+  bool too_large = false;
+  uint8_t * const prefix = lzip_name ? 0 :
+    decode_prefix( mbuffer, msize, good_dsize, dictionary_size, too_large );
+  if( !lzip_name && !prefix )
+    {
+    if( !too_large ) { munmap( (void *)rbuf, rsize ); return fatal( 1 ); }
+    lzip_name = "lzip";
+    if( verbosity >= 1 )
+      { print_pending_newline( terminator );
+        std::printf( "Prefix data too large for memory, using '%s'.\n",
+                     lzip_name ); std::fflush( stdout ); }
+    }
+  // match length limits of levels -0 to -9
+  const int len_limits[10] = { 16, 5, 6, 8, 12, 20, 36, 68, 132, 273 };
   char level_str[8] = "-0";	// compression level or match length limit
   char dict_str[16];
   snprintf( dict_str, sizeof dict_str, "-s%u", dictionary_size );
   const char * lzip0_argv[3] = { lzip_name, "-0", 0 };
   const char * lzip_argv[4] = { lzip_name, level_str, dict_str, 0 };
+  int ret = -1;
   if( lzip_level >= 0 )
-    for( unsigned char level = '0'; level <= '9'; ++level )
+    for( unsigned char level = '0'; level <= '9' && ret < 0; ++level )
       {
       if( std::isdigit( lzip_level ) && level != lzip_level ) continue;
       level_str[1] = level;
@@ -480,15 +642,19 @@ int reproduce_member( uint8_t * const mbuffer, const long msize,
         }
       const bool level0 = level == '0';
       const bool auto0 = level0 && lzip_level != '0';
-      int ret = try_reproduce( mbuffer, msize, dsize, good_dsize, begin, end,
-                               rbuf, rsize, offset, dictionary_size,
+      if( prefix )		// level 0 uses the fast encoder with 64 KiB
+        ret = try_reproduce_lzlib( mbuffer, msize, dsize, good_dsize, begin,
+                 end, rbuf, rsize, offset, dictionary_size, prefix,
+                 level0 ? 65535 : dictionary_size, len_limits[level-'0'],
+                 md5sump, terminator );
+      else
+        ret = try_reproduce( mbuffer, msize, dsize, good_dsize, begin, end,
+                             rbuf, rsize, offset, dictionary_size,
                 level0 ? lzip0_argv : lzip_argv, md5sump, terminator, auto0 );
-      if( ret >= 0 )
-        { delete master; munmap( (void *)rbuf, rsize ); return ret; }
       }
   if( lzip_level <= 0 )
     {
-    for( int len = min_match_len_limit; len <= max_match_len; ++len )
+    for( int len = min_match_len_limit; len <= max_match_len && ret < 0; ++len )
       {
       if( lzip_level < -1 && -lzip_level != len ) continue;
       snprintf( level_str, sizeof level_str, "-m%u", len );
@@ -497,16 +663,19 @@ int reproduce_member( uint8_t * const mbuffer, const long msize,
         std::printf( "Trying match length limit %d %c", len, terminator );
         std::fflush( stdout ); pending_newline = true;
         }
-      int ret = try_reproduce( mbuffer, msize, dsize, good_dsize, begin, end,
-                               rbuf, rsize, offset, dictionary_size,
-                               lzip_argv, md5sump, terminator );
-      if( ret >= 0 )
-        { delete master; munmap( (void *)rbuf, rsize ); return ret; }
+      if( prefix )
+        ret = try_reproduce_lzlib( mbuffer, msize, dsize, good_dsize, begin,
+                 end, rbuf, rsize, offset, dictionary_size, prefix,
+                 dictionary_size, len, md5sump, terminator );
+      else
+        ret = try_reproduce( mbuffer, msize, dsize, good_dsize, begin, end,
+                             rbuf, rsize, offset, dictionary_size,
+                             lzip_argv, md5sump, terminator );
       }
     }
-  delete master;
+  delete[] prefix;
   munmap( (void *)rbuf, rsize );
-  return 2;
+  return ( ret >= 0 ) ? ret : 2;
   }
 
 } // end namespace
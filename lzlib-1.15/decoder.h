@@ -193,6 +193,84 @@ static inline unsigned Rd_decode_bit( Range_decoder * const rdec,
     }
   }
 
+/* Branchless counterparts of the bit and tree decoders. Compressed data is
+   close to random, so instead of branching on each bit they select the new
+   range, code, and probability with masks. The tree decoders work on local
+   copies of range and code, which the compiler can keep in registers.
+   They replace the branchy tree decoders if LZ_BRANCHLESS_DECODER is
+   defined at build time. */
+static inline void Rd_normalize_bl( Range_decoder * const rdec,
+                                    uint32_t * const rng, uint32_t * const cod )
+  {
+  if( *rng <= 0x00FFFFFFU )
+    { *rng <<= 8; *cod = (*cod << 8) | Rd_get_byte( rdec ); }
+  }
+
+static inline unsigned Rd_decode_bit_bl( Bit_model * const probability,
+                                         uint32_t * const rng,
+                                         uint32_t * const cod )
+  {
+  const uint32_t bound = ( *rng >> bit_model_total_bits ) * *probability;
+  const uint32_t mask = 0U - ( *cod >= bound );	/* all ones if bit is 1 */
+  const int m = mask;
+  const int p = *probability;
+  *cod -= bound & mask;
+  *rng = bound + ( ( *rng - 2 * bound ) & mask );
+  *probability = p +
+    ( ( ( bit_model_total - p ) >> bit_model_move_bits ) & ~m ) -
+    ( ( p >> bit_model_move_bits ) & m );
+  return mask & 1;
+  }
+
+static inline unsigned Rd_decode_tree_bl( Range_decoder * const rdec,
+                                          Bit_model bm[], const int num_bits )
+  {
+  uint32_t rng = rdec->range, cod = rdec->code;
+  unsigned symbol = 1;
+  int i;
+  for( i = 0; i < num_bits; ++i )
+    {
+    Rd_normalize_bl( rdec, &rng, &cod );
+    symbol = ( symbol << 1 ) | Rd_decode_bit_bl( &bm[symbol], &rng, &cod );
+    }
+  rdec->range = rng; rdec->code = cod;
+  return symbol - ( 1U << num_bits );
+  }
+
+static inline unsigned Rd_decode_matched_bl( Range_decoder * const rdec,
+                                             Bit_model bm[],
+                                             unsigned match_byte )
+  {
+  uint32_t rng = rdec->range, cod = rdec->code;
+  unsigned symbol = 1;
+  unsigned mask = 0x100;
+  do {
+    const unsigned match_bit = ( match_byte <<= 1 ) & mask;
+    Rd_normalize_bl( rdec, &rng, &cod );
+    const unsigned bit =
+      Rd_decode_bit_bl( &bm[symbol+match_bit+mask], &rng, &cod );
+    symbol = ( symbol << 1 ) | bit;
+    mask &= ~(match_bit ^ (bit << 8));	/* if( match_bit != bit ) mask = 0; */
+    } while( symbol < 0x100 );
+  rdec->range = rng; rdec->code = cod;
+  return symbol & 0xFF;
+  }
+
+static inline unsigned Rd_decode_len_bl( Range_decoder * const rdec,
+                                         Len_model * const lm,
+                                         const int pos_state )
+  {
+  Rd_normalize( rdec );
+  if( Rd_decode_bit_bl( &lm->choice1, &rdec->range, &rdec->code ) == 0 )
+    return Rd_decode_tree_bl( rdec, lm->bm_low[pos_state], 3 ) + min_match_len;
+  Rd_normalize( rdec );
+  if( Rd_decode_bit_bl( &lm->choice2, &rdec->range, &rdec->code ) == 0 )
+    return Rd_decode_tree_bl( rdec, lm->bm_mid[pos_state], 3 ) +
+           min_match_len + len_low_symbols;
+  return Rd_decode_tree_bl( rdec, lm->bm_high, 8 ) +
+         min_match_len + len_low_symbols + len_mid_symbols;
+  }
+
 static inline void Rd_decode_symbol_bit( Range_decoder * const rdec,
                          Bit_model * const probability, unsigned * symbol )
   {
@@ -238,6 +316,9 @@ static inline void Rd_decode_symbol_bit_reversed( Range_decoder * const rdec,
 static inline unsigned Rd_decode_tree6( Range_decoder * const rdec,
                                         Bit_model bm[] )
   {
+#if defined LZ_BRANCHLESS_DECODER
+  return Rd_decode_tree_bl( rdec, bm, 6 );
+#else
   unsigned symbol = 1;
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
@@ -246,11 +327,15 @@ static inline unsigned Rd_decode_tree6( Range_decoder * const rdec,
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
   return symbol & 0x3F;
+#endif
   }
 
 static inline unsigned Rd_decode_tree8( Range_decoder * const rdec,
                                         Bit_model bm[] )
   {
+#if defined LZ_BRANCHLESS_DECODER
+  return Rd_decode_tree_bl( rdec, bm, 8 );
+#else
   unsigned symbol = 1;
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
@@ -261,6 +346,7 @@ static inline unsigned Rd_decode_tree8( Range_decoder * const rdec,
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
   return symbol & 0xFF;
+#endif
   }
 
 static inline unsigned
@@ -290,6 +376,9 @@ Rd_decode_tree_reversed4( Range_decoder * const rdec, Bit_model bm[] )
 static inline unsigned Rd_decode_matched( Range_decoder * const rdec,
                                           Bit_model bm[], unsigned match_byte )
   {
+#if defined LZ_BRANCHLESS_DECODER
+  return Rd_decode_matched_bl( rdec, bm, match_byte );
+#else
   unsigned symbol = 1;
   unsigned mask = 0x100;
   while( true )
@@ -300,12 +389,16 @@ static inline unsigned Rd_decode_matched( Range_decoder * const rdec,
     if( symbol > 0xFF ) return symbol & 0xFF;
     mask &= ~(match_bit ^ (bit << 8));	/* if( match_bit != bit ) mask = 0; */
     }
+#endif
   }
 
 static inline unsigned Rd_decode_len( Range_decoder * const rdec,
                                       Len_model * const lm,
                                       const int pos_state )
   {
+#if defined LZ_BRANCHLESS_DECODER
+  return Rd_decode_len_bl( rdec, lm, pos_state );
+#else
   Bit_model * bm;
   unsigned mask, offset, symbol = 1;
 
@@ -324,6 +417,7 @@ len3:
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
   Rd_decode_symbol_bit( rdec, &bm[symbol], &symbol );
   return ( symbol & mask ) + min_match_len + offset;
+#endif
   }
 
 
@@ -17,6 +17,20 @@
    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
 */
 
+/* compute the hash keys of the 2, 3 and 4 bytes at 'data' */
+static inline void LZe_get_keys( const LZ_encoder * const e,
+                                 const uint8_t * const data, int * const key2,
+                                 int * const key3, int * const key4 )
+  {
+  unsigned tmp = crc32[data[0]] ^ data[1];
+  *key2 = tmp & ( num_prev_positions2 - 1 );
+  tmp ^= (unsigned)data[2] << 8;
+  *key3 = num_prev_positions2 + ( tmp & ( num_prev_positions3 - 1 ) );
+  *key4 = num_prev_positions2 + num_prev_positions3 +
+          ( ( tmp ^ ( crc32[data[3]] << 5 ) ) & e->eb.mb.key4_mask );
+  }
+
+
 static int LZe_get_match_pairs( LZ_encoder * const e, Pair * pairs )
   {
   int32_t * ptr0 = e->eb.mb.pos_array + ( e->eb.mb.cyclic_pos << 1 );
@@ -35,12 +49,20 @@ static int LZe_get_match_pairs( LZ_encoder * const e, Pair * pairs )
                        e->eb.mb.pos - e->eb.mb.dictionary_size : 0;
   const uint8_t * const data = Mb_ptr_to_current_pos( &e->eb.mb );
 
-  unsigned tmp = crc32[data[0]] ^ data[1];
-  const int key2 = tmp & ( num_prev_positions2 - 1 );
-  tmp ^= (unsigned)data[2] << 8;
-  const int key3 = num_prev_positions2 + ( tmp & ( num_prev_positions3 - 1 ) );
-  const int key4 = num_prev_positions2 + num_prev_positions3 +
-                   ( ( tmp ^ ( crc32[data[3]] << 5 ) ) & e->eb.mb.key4_mask );
+  int key2, key3, key4;
+  LZe_get_keys( e, data, &key2, &key3, &key4 );
+
+  /* Hide the latency of the next calls. The buckets of pos + 1 were
+     prefetched by the previous call, so now its root node can be fetched. */
+  if( Mb_available_bytes( &e->eb.mb ) > prefetch_distance + 3 )
+    {
+    int k2, k3, k4;
+    LZe_get_keys( e, data + 1, &k2, &k3, &k4 );
+    Mb_prefetch_node( &e->eb.mb, e->eb.mb.prev_positions[k4] );
+    LZe_get_keys( e, data + prefetch_distance, &k2, &k3, &k4 );
+    Mb_prefetch_bucket( &e->eb.mb, k3 );
+    Mb_prefetch_bucket( &e->eb.mb, k4 );
+    }
 
   if( pairs )
     {
@@ -121,37 +143,62 @@ static int LZe_get_match_pairs( LZ_encoder * const e, Pair * pairs )
   }
 
 
+/* Only the prices of the models changed since the last call are
+   recalculated. The result is the same as recalculating all of them. */
 static void LZe_update_distance_prices( LZ_encoder * const e )
   {
-  int dis, len_state;
-  for( dis = start_dis_model; dis < modeled_distances; ++dis )
+  int dis, dis_slot, len_state;
+  for( dis_slot = start_dis_model; dis_slot < end_dis_model; ++dis_slot )
     {
-    const int dis_slot = dis_slots[dis];
+    if( !e->dis_dirty[dis_slot] ) continue;
     const int direct_bits = ( dis_slot >> 1 ) - 1;
     const int base = ( 2 | ( dis_slot & 1 ) ) << direct_bits;
-    const int price = price_symbol_reversed( e->eb.bm_dis + ( base - dis_slot ),
-                                             dis - base, direct_bits );
-    for( len_state = 0; len_state < len_states; ++len_state )
-      e->dis_prices[len_state][dis] = price;
+    const int end = base + ( 1 << direct_bits );
+    for( dis = base; dis < end; ++dis )
+      e->direct_dis_prices[dis] = price_symbol_reversed(
+        e->eb.bm_dis + ( base - dis_slot ), dis - base, direct_bits );
     }
 
   for( len_state = 0; len_state < len_states; ++len_state )
     {
     int * const dsp = e->dis_slot_prices[len_state];
-    const Bit_model * const bmds = e->eb.bm_dis_slot[len_state];
-    int slot = 0;
-    for( ; slot < end_dis_model; ++slot )
-      dsp[slot] = price_symbol6( bmds, slot );
-    for( ; slot < e->num_dis_slots; ++slot )
-      dsp[slot] = price_symbol6( bmds, slot ) +
-                  (((( slot >> 1 ) - 1 ) - dis_align_bits ) << price_shift_bits );
+    const bool slot_dirty = e->dis_slot_dirty[len_state];
+    if( slot_dirty )
+      {
+      const Bit_model * const bmds = e->eb.bm_dis_slot[len_state];
+      int slot = 0;
+      for( ; slot < end_dis_model; ++slot )
+        dsp[slot] = price_symbol6( bmds, slot );
+      for( ; slot < e->num_dis_slots; ++slot )
+        dsp[slot] = price_symbol6( bmds, slot ) +
+          (((( slot >> 1 ) - 1 ) - dis_align_bits ) << price_shift_bits );
+      }
 
     int * const dp = e->dis_prices[len_state];
-    for( dis = 0; dis < start_dis_model; ++dis )
-      dp[dis] = dsp[dis];
-    for( ; dis < modeled_distances; ++dis )
-      dp[dis] += dsp[dis_slots[dis]];
+    if( slot_dirty )
+      for( dis = 0; dis < start_dis_model; ++dis )
+        dp[dis] = dsp[dis];
+    for( dis = start_dis_model; dis < modeled_distances; ++dis )
+      {
+      dis_slot = dis_slots[dis];
+      if( slot_dirty || e->dis_dirty[dis_slot] )
+        dp[dis] = e->direct_dis_prices[dis] + dsp[dis_slot];
+      }
+    e->dis_slot_dirty[len_state] = false;
     }
+  for( dis_slot = start_dis_model; dis_slot < end_dis_model; ++dis_slot )
+    e->dis_dirty[dis_slot] = false;
+  }
+
+
+static void LZe_update_align_prices( LZ_encoder * const e )
+  {
+  int i;
+  if( !e->align_dirty ) return;
+  for( i = 0; i < dis_align_size; ++i )
+    e->align_prices[i] =
+      price_symbol_reversed( e->eb.bm_align, i, dis_align_bits );
+  e->align_dirty = false;
   }
 
 
@@ -505,8 +552,7 @@ static bool LZe_encode_member( LZ_encoder * const e )
       if( e->align_price_counter <= 0 )
         {
         e->align_price_counter = align_price_count;
-        for( i = 0; i < dis_align_size; ++i )
-          e->align_prices[i] = price_symbol_reversed( e->eb.bm_align, i, dis_align_bits );
+        LZe_update_align_prices( e );
         }
       Lp_update_prices( &e->match_len_prices );
       Lp_update_prices( &e->rep_len_prices );
@@ -559,7 +605,7 @@ static bool LZe_encode_member( LZ_encoder * const e )
           else
             {
             Re_encode_len( &e->eb.renc, &e->eb.rep_len_model, len, pos_state );
-            Lp_decrement_counter( &e->rep_len_prices, pos_state );
+            Lp_decrement_counter( &e->rep_len_prices, pos_state, len );
             *state = St_set_rep( *state );
             }
           }
@@ -567,9 +613,13 @@ static bool LZe_encode_member( LZ_encoder * const e )
           {
           dis -= num_rep_distances;
           LZeb_encode_pair( &e->eb, dis, len, pos_state );
-          if( dis >= modeled_distances ) --e->align_price_counter;
+          const int dis_slot = get_slot( dis );
+          e->dis_slot_dirty[get_len_state(len)] = true;
+          if( dis_slot >= end_dis_model )
+            { --e->align_price_counter; e->align_dirty = true; }
+          else if( dis_slot >= start_dis_model ) e->dis_dirty[dis_slot] = true;
           --e->dis_price_counter;
-          Lp_decrement_counter( &e->match_len_prices, pos_state );
+          Lp_decrement_counter( &e->match_len_prices, pos_state, len );
           *state = St_set_match( *state );
           }
         }
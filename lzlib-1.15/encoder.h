@@ -23,7 +23,9 @@ typedef struct Len_prices
   int len_symbols;
   int count;
   int prices[pos_states][max_len_symbols];
+  int high_symbol_prices[len_high_symbols];	/* prices of lm->bm_high */
   int counters[pos_states];			/* may decrement below 0 */
+  bool high_dirty;				/* lm->bm_high has changed */
   } Len_prices;
 
 static inline void Lp_update_low_mid_prices( Len_prices * const lp,
@@ -46,14 +48,25 @@ static inline void Lp_update_high_prices( Len_prices * const lp )
   const int tmp = price1( lp->lm->choice1 ) + price1( lp->lm->choice2 );
   int len;
   for( len = len_low_symbols + len_mid_symbols; len < lp->len_symbols; ++len )
+    {
+    int * const hsp =
+      &lp->high_symbol_prices[len-len_low_symbols-len_mid_symbols];
+    if( lp->high_dirty )
+      *hsp = price_symbol8( lp->lm->bm_high,
+                            len - len_low_symbols - len_mid_symbols );
     /* using 4 slots per value makes "Lp_price" faster */
     lp->prices[3][len] = lp->prices[2][len] =
-    lp->prices[1][len] = lp->prices[0][len] = tmp +
-      price_symbol8( lp->lm->bm_high, len - len_low_symbols - len_mid_symbols );
+    lp->prices[1][len] = lp->prices[0][len] = tmp + *hsp;
+    }
+  lp->high_dirty = false;
   }
 
 static inline void Lp_reset( Len_prices * const lp )
-  { int i; for( i = 0; i < pos_states; ++i ) lp->counters[i] = 0; }
+  {
+  int i;
+  for( i = 0; i < pos_states; ++i ) lp->counters[i] = 0;
+  lp->high_dirty = true;
+  }
 
 static inline void Lp_init( Len_prices * const lp, const Len_model * const lm,
                             const int match_len_limit )
@@ -64,9 +77,14 @@ static inline void Lp_init( Len_prices * const lp, const Len_model * const lm,
   Lp_reset( lp );
   }
 
+/* call after encoding 'len' with lp->lm */
 static inline void Lp_decrement_counter( Len_prices * const lp,
-                                         const int pos_state )
-  { --lp->counters[pos_state]; }
+                                         const int pos_state, const int len )
+  {
+  --lp->counters[pos_state];
+  if( len >= min_match_len + len_low_symbols + len_mid_symbols )
+    lp->high_dirty = true;
+  }
 
 static inline void Lp_update_prices( Len_prices * const lp )
   {
@@ -147,8 +165,13 @@ typedef struct LZ_encoder
 
   int dis_slot_prices[len_states][2*max_dictionary_bits];
   int dis_prices[len_states][modeled_distances];
+  int direct_dis_prices[modeled_distances];	/* bm_dis part of dis_prices */
   int align_prices[dis_align_size];
   int num_dis_slots;
+  /* the models below have changed since their prices were last computed */
+  bool dis_slot_dirty[len_states];
+  bool dis_dirty[end_dis_model];		/* bm_dis of each dis_slot */
+  bool align_dirty;
   int price_counter;		/* counters may decrement below 0 */
   int dis_price_counter;
   int align_price_counter;
@@ -278,7 +301,16 @@ static inline void LZe_backward( LZ_encoder * const e, int cur )
   }
 
 enum { num_prev_positions3 = 1 << 16,
-       num_prev_positions2 = 1 << 10 };
+       num_prev_positions2 = 1 << 10,
+       prefetch_distance = 2 };	/* positions ahead to prefetch buckets */
+
+static inline void LZe_set_prices_dirty( LZ_encoder * const e )
+  {
+  int i;
+  for( i = 0; i < len_states; ++i ) e->dis_slot_dirty[i] = true;
+  for( i = 0; i < end_dis_model; ++i ) e->dis_dirty[i] = true;
+  e->align_dirty = true;
+  }
 
 static inline bool LZe_init( LZ_encoder * const e,
                              const int dict_size, const int len_limit,
@@ -306,6 +338,7 @@ static inline bool LZe_init( LZ_encoder * const e,
   e->price_counter = 0;
   e->dis_price_counter = 0;
   e->align_price_counter = 0;
+  LZe_set_prices_dirty( e );
   e->been_flushed = false;
   return true;
   }
@@ -320,5 +353,6 @@ static inline void LZe_reset( LZ_encoder * const e,
   e->price_counter = 0;
   e->dis_price_counter = 0;
   e->align_price_counter = 0;
+  LZe_set_prices_dirty( e );
   e->been_flushed = false;
   }
@@ -71,6 +71,7 @@ static bool Mb_init( Matchfinder_base * const mb, const int before_size,
   size += num_prev_positions23;
   mb->num_prev_positions = size;
 
+  mb->pos_array_factor = pos_array_factor;
   mb->pos_array_size = pos_array_factor * ( mb->dictionary_size + 1 );
   size += mb->pos_array_size;
   if( size * sizeof mb->prev_positions[0] <= size ) mb->prev_positions = 0;
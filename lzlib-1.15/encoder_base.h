@@ -217,6 +217,17 @@ static inline int price_matched( const Bit_model bm[], unsigned symbol,
   }
 
 
+/* Ask the cache to load the line containing 'p'. Does not fault. */
+static inline void prefetch( const void * const p )
+  {
+#if defined __GNUC__
+  __builtin_prefetch( p );
+#else
+  (void)p;
+#endif
+  }
+
+
 typedef struct Matchfinder_base
   {
   unsigned long long partial_data_pos;
@@ -235,6 +246,7 @@ typedef struct Matchfinder_base
   int num_prev_positions23;
   int num_prev_positions;	/* size of prev_positions */
   int pos_array_size;
+  int pos_array_factor;		/* nodes per position in pos_array */
   int saved_dictionary_size;	/* dictionary_size restored by Mb_reset */
   bool at_stream_end;		/* stream_pos shows real end of file */
   bool sync_flush_pending;
@@ -303,6 +315,21 @@ static inline int Mb_true_match_len( const Matchfinder_base * const mb,
   return i;
   }
 
+static inline void Mb_prefetch_bucket( const Matchfinder_base * const mb,
+                                       const int key )
+  { prefetch( mb->prev_positions + key ); }
+
+/* prefetch the tree or chain node of the position stored as 'newpos1' */
+static inline void Mb_prefetch_node( const Matchfinder_base * const mb,
+                                     const int newpos1 )
+  {
+  const int delta = mb->pos + 1 - newpos1;
+  if( newpos1 <= 0 || delta < 0 || delta > mb->dictionary_size ) return;
+  int i = mb->cyclic_pos - delta;
+  if( i < 0 ) i += mb->dictionary_size + 1;
+  prefetch( mb->pos_array + i * mb->pos_array_factor );
+  }
+
 static inline bool Mb_move_pos( Matchfinder_base * const mb )
   {
   if( ++mb->cyclic_pos > mb->dictionary_size ) mb->cyclic_pos = 0;
@@ -247,7 +247,12 @@ int LZ_compress_read( LZ_Encoder * const e,
         ( e->lz_encoder && !LZe_encode_member( e->lz_encoder ) ) )
       { e->lz_errno = LZ_library_error; e->fatal = true; return -1; }
     if( eb->mb.sync_flush_pending && Mb_available_bytes( &eb->mb ) <= 0 )
+      {
       LZeb_try_sync_flush( eb );
+      /* the marker has updated the distance models */
+      if( e->lz_encoder && !eb->mb.sync_flush_pending )
+        LZe_set_prices_dirty( e->lz_encoder );
+      }
     out_size += Re_read_data( &eb->renc, buffer + out_size, size - out_size );
     }
   return out_size; }
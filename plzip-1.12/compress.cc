@@ -28,7 +28,9 @@
 #include <string>
 #include <vector>
 #include <stdint.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <lzlib.h>
 
 #include "lzip.h"
@@ -177,6 +179,7 @@ private:
   std::vector< Packet > circular_ibuffer;
   std::vector< const Packet * > circular_obuffer;	// pointers to ibuffer
   int num_working;			// number of workers still running
+  int num_idle;			// number of workers waiting for a packet
   const int num_slots;			// max packets in circulation
   pthread_mutex_t imutex;
   pthread_cond_t iav_or_eof;	// input packet available or splitter done
@@ -194,7 +197,7 @@ public:
       receive_id( 0 ), distrib_id( 0 ), deliver_id( 0 ),
       slot_tally( slots ), circular_ibuffer( slots ),
       circular_obuffer( slots, (const Packet *) 0 ),
-      num_working( workers ), num_slots( slots ), eof( false )
+      num_working( workers ), num_idle( 0 ), num_slots( slots ), eof( false )
     {
     xinit_mutex( &imutex ); xinit_cond( &iav_or_eof );
     xinit_mutex( &omutex ); xinit_cond( &oav_or_exit );
@@ -224,8 +227,9 @@ public:
     ++icheck_counter;
     while( receive_id == distrib_id && !eof )	// no packets to distribute
       {
-      ++iwait_counter;
+      ++iwait_counter; ++num_idle;
       xwait( &iav_or_eof, &imutex );
+      --num_idle;
       }
     if( receive_id != distrib_id )
       { Packet * ipacket = &circular_ibuffer[distrib_id % num_slots];
@@ -237,6 +241,17 @@ public:
     return 0;			// EOF
     }
 
+  /* Return true if the workers waiting for a packet can take all the
+     packets not yet distributed. Then a new worker would not make the
+     compression faster because the splitter is the bottleneck. */
+  bool idle_workers_suffice()
+    {
+    xlock( &imutex );
+    const bool suffice = num_idle >= (int)( receive_id - distrib_id );
+    xunlock( &imutex );
+    return suffice;
+    }
+
   // collect a packet from a worker
   void collect_packet( const Packet * const opacket )
     {
@@ -321,11 +336,85 @@ struct Splitter_arg
   const int data_size;
   const int infd;
   int num_workers;		// returned by splitter to main thread
+  const bool direct_io;		// infd has O_DIRECT set
   Splitter_arg( Packet_courier & co, const Pretty_print & pp_, const int dis,
                 const int mll, const int off, pthread_t * wt, const int das,
-                const int ifd, const int nw )
+                const int ifd, const int nw, const bool dio )
     : worker_arg( co, pp_, dis, mll, off ), worker_threads( wt ),
-      data_size( das ), infd( ifd ), num_workers( nw ) {}
+      data_size( das ), infd( ifd ), num_workers( nw ), direct_io( dio ) {}
+  };
+
+
+/* Read a file opened with O_DIRECT, which requires aligned buffers, sizes,
+   and file offsets, in aligned blocks, and return its data in pieces of
+   any size. If the file system rejects the alignment, clear O_DIRECT and
+   go on reading through the page cache.
+*/
+class Direct_reader
+  {
+  enum { block_size = 1 << 20, alignment = 4096 };
+  uint8_t * const base_buffer;
+  uint8_t * const buffer;		// base_buffer aligned to alignment
+  int pos;				// current position in buffer
+  int stream_pos;			// data in buffer
+  const int fd;
+  bool at_eof;
+
+  Direct_reader( const Direct_reader & );	// declared as private
+  void operator=( const Direct_reader & );	// declared as private
+
+  bool clear_direct()
+    {
+#ifdef O_DIRECT
+    const int flags = fcntl( fd, F_GETFL );
+    return flags >= 0 && ( flags & O_DIRECT ) &&
+           fcntl( fd, F_SETFL, flags & ~O_DIRECT ) == 0;
+#else
+    return false;
+#endif
+    }
+
+  bool fill()			// return false if error, with errno set
+    {
+    pos = stream_pos = 0;
+    while( stream_pos < block_size )
+      {
+      const int n = read( fd, buffer + stream_pos, block_size - stream_pos );
+      if( n > 0 ) stream_pos += n;
+      else if( n == 0 ) { at_eof = true; break; }
+      else if( errno == EINVAL && clear_direct() ) {}
+      else if( errno != EINTR ) return false;
+      }
+    return true;
+    }
+
+public:
+  explicit Direct_reader( const int ifd )
+    : base_buffer( new( std::nothrow ) uint8_t[block_size+alignment] ),
+      buffer( base_buffer + ( alignment -
+              (uintptr_t)base_buffer % alignment ) % alignment ),
+      pos( 0 ), stream_pos( 0 ), fd( ifd ), at_eof( false ) {}
+
+  ~Direct_reader() { delete[] base_buffer; }
+
+  bool ok() const { return base_buffer != 0; }
+
+  // same return value and errno as readblock
+  int readblock( uint8_t * const buf, const int size )
+    {
+    int sz = 0;
+    errno = 0;
+    while( sz < size )
+      {
+      if( pos >= stream_pos && ( at_eof || !fill() || stream_pos == 0 ) )
+        break;
+      const int n = std::min( size - sz, stream_pos - pos );
+      std::memcpy( buf + sz, buffer + pos, n );
+      pos += n; sz += n;
+      }
+    if( sz >= size || at_eof ) errno = 0;
+    return sz;
+    }
   };
 
 
@@ -406,7 +495,8 @@ extern "C" void * cworker( void * arg )
 
 /* Split data from input file into chunks and pass them to courier for
    packaging and distribution to workers.
-   Start a worker per packet up to a maximum of num_workers.
+   Start a worker per packet up to a maximum of num_workers, unless the
+   workers already started are waiting for packets.
 */
 extern "C" void * csplitter( void * arg )
   {
@@ -418,20 +508,36 @@ extern "C" void * csplitter( void * arg )
   const int infd = tmp.infd;
   const int data_size = tmp.data_size;
   int i = 0;				// number of workers started
+  Direct_reader * const reader =
+    tmp.direct_io ? new( std::nothrow ) Direct_reader( infd ) : 0;
+  if( tmp.direct_io && ( !reader || !reader->ok() ) )
+    { pp( mem_msg ); cleanup_and_fail(); }
+  // position of next data in a seekable file read through the page cache
+  long long file_pos = reader ? -1 : lseek( infd, 0, SEEK_CUR );
+#ifdef POSIX_FADV_SEQUENTIAL
+  if( file_pos >= 0 ) posix_fadvise( infd, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
 
   for( bool first_post = true; ; first_post = false )
     {
     uint8_t * const data = new( std::nothrow ) uint8_t[offset+data_size];
     if( !data ) { pp( mem_msg2 ); cleanup_and_fail(); }
-    const int size = readblock( infd, data + offset, data_size );
+    const int size = reader ? reader->readblock( data + offset, data_size ) :
+                              readblock( infd, data + offset, data_size );
     if( size != data_size && errno )
       { pp(); show_error( "Read error", errno ); cleanup_and_fail(); }
+#ifdef POSIX_FADV_WILLNEED
+    // start reading the next packet while waiting for a free slot
+    if( file_pos >= 0 && size == data_size )
+      { file_pos += size;
+        posix_fadvise( infd, file_pos, data_size, POSIX_FADV_WILLNEED ); }
+#endif
 
     if( size > 0 || first_post )	// first packet may be empty
       {
       in_size += size;
       courier.receive_packet( data, size );
-      if( i < tmp.num_workers )		// start a new worker
+      if( i < tmp.num_workers && !courier.idle_workers_suffice() )
         {
         const int errcode =
           pthread_create( &worker_threads[i++], 0, cworker, &tmp.worker_arg );
@@ -442,6 +548,7 @@ extern "C" void * csplitter( void * arg )
       }
     else { delete[] data; break; }
     }
+  delete reader;
   courier.finish( tmp.num_workers - i );	// no more packets to send
   tmp.num_workers = i;
   return 0;
@@ -479,24 +586,38 @@ void muxer( Packet_courier & courier, const Pretty_print & pp, const int outfd )
 int compress( const unsigned long long cfile_size,
               const int data_size, const int dictionary_size,
               const int match_len_limit, const int num_workers,
-              const int infd, const int outfd,
-              const Pretty_print & pp, const int debug_level )
+              const int slots_per_worker, const int infd, const int outfd,
+              const Cl_options & cl_opts, const Pretty_print & pp,
+              const int debug_level )
   {
   const int offset = data_size / 8;	// offset for compression in-place
-  const int slots_per_worker = 2;
   const int num_slots =
     ( ( num_workers > 1 ) ? num_workers * slots_per_worker : 1 );
+  bool direct_io = false;
+#ifdef O_DIRECT
+  if( cl_opts.direct_io )
+    {
+    struct stat st;
+    const int flags = fcntl( infd, F_GETFL );
+    direct_io = infd != STDIN_FILENO && fstat( infd, &st ) == 0 &&
+                S_ISREG( st.st_mode ) && flags >= 0 &&
+                fcntl( infd, F_SETFL, flags | O_DIRECT ) == 0;
+    }
+#endif
   in_size = 0;
   out_size = 0;
   Packet_courier courier( num_workers, num_slots );
 
-  if( debug_level & 2 ) std::fputs( "compress.\n", stderr );
+  if( debug_level & 2 )
+    std::fputs( direct_io ? "compress with O_DIRECT.\n" : "compress.\n",
+                stderr );
 
   pthread_t * worker_threads = new( std::nothrow ) pthread_t[num_workers];
   if( !worker_threads ) { pp( mem_msg ); return 1; }
 
   Splitter_arg splitter_arg( courier, pp, dictionary_size, match_len_limit,
-               offset, worker_threads, data_size, infd, num_workers );
+               offset, worker_threads, data_size, infd, num_workers,
+               direct_io );
 
   pthread_t splitter_thread;
   int errcode = pthread_create( &splitter_thread, 0, csplitter, &splitter_arg );
@@ -58,9 +58,14 @@ class Packet_courier			// moves packets around
 public:
   unsigned ocheck_counter;
   unsigned owait_counter;
+  Memory_budget budget;			// limits the members in flight
 private:
-  int deliver_id;		// worker queue currently delivering packets
+  const unsigned long long member_memory;	// memory reserved per member
+  // worker queues holding the members in order, front is delivering packets
+  std::queue< int > deliver_ids;
   std::vector< std::queue< Packet > > opacket_queues;
+  long next_member;			// next member to be decompressed
+  const long num_members;		// number of members in file
   int num_working;			// number of workers still running
   const int num_workers;		// number of workers
   const unsigned out_slots;		// max output packets per queue
@@ -73,10 +78,14 @@ private:
   void operator=( const Packet_courier & );	// declared as private
 
 public:
-  Packet_courier( const Shared_retval & sh_ret, const int workers,
-                  const int slots )
-    : ocheck_counter( 0 ), owait_counter( 0 ), deliver_id( 0 ),
-      opacket_queues( workers ), num_working( workers ), num_workers( workers ),
+  Packet_courier( const Shared_retval & sh_ret, const long members,
+                  const int workers, const int slots,
+                  const unsigned long long max_memory,
+                  const unsigned long long mem_per_member )
+    : ocheck_counter( 0 ), owait_counter( 0 ), budget( max_memory ),
+      member_memory( mem_per_member ), opacket_queues( workers ),
+      next_member( 0 ), num_members( members ), num_working( workers ),
+      num_workers( workers ),
       out_slots( slots ), slot_av( workers ), shared_retval( sh_ret )
     {
     xinit_mutex( &omutex ); xinit_cond( &oav_or_exit );
@@ -93,6 +102,25 @@ public:
     xdestroy_cond( &oav_or_exit ); xdestroy_mutex( &omutex );
     }
 
+  /* Assign to worker the next member in file order, or return -1 if no
+     members are left. The packets of the member will be delivered after
+     those of the members assigned before it.
+     Memory is reserved before taking the member so that the first member
+     not yet delivered always has its memory and can progress. */
+  long get_member( const int worker_id )
+    {
+    long i = -1;
+    budget.reserve( member_memory );
+    xlock( &omutex );
+    if( next_member < num_members && !shared_retval() )
+      { i = next_member++; deliver_ids.push( worker_id ); }
+    xunlock( &omutex );
+    if( i < 0 ) budget.release( member_memory );
+    return i;
+    }
+
+  void member_done() { budget.release( member_memory ); }
+
   void worker_finished()
     {
     // notify muxer when last worker exits
@@ -114,12 +142,16 @@ public:
         xwait( &slot_av[worker_id], &omutex );
         }
     opacket_queues[worker_id].push( opacket );
-    if( worker_id == deliver_id ) xsignal( &oav_or_exit );
+    if( worker_id == deliver_ids.front() ) xsignal( &oav_or_exit );
 out: xunlock( &omutex );
     }
 
+  bool deliver_queue_empty() const
+    { return deliver_ids.empty() ||
+             opacket_queues[deliver_ids.front()].empty(); }
+
   /* deliver packets to muxer
-     if opacket.eom, move to next queue
+     if opacket.eom, move to the queue of next member
      if opacket.data == 0, skip opacket */
   void deliver_packets( std::vector< Packet > & packet_vector )
     {
@@ -127,15 +159,16 @@ out: xunlock( &omutex );
     xlock( &omutex );
     ++ocheck_counter;
     do {
-      while( opacket_queues[deliver_id].empty() && num_working > 0 )
+      while( deliver_queue_empty() && num_working > 0 )
         { ++owait_counter; xwait( &oav_or_exit, &omutex ); }
-      while( !opacket_queues[deliver_id].empty() )
+      while( !deliver_queue_empty() )
         {
+        const int deliver_id = deliver_ids.front();
         Packet opacket = opacket_queues[deliver_id].front();
         opacket_queues[deliver_id].pop();
         if( opacket_queues[deliver_id].size() + 1 == out_slots )
           xsignal( &slot_av[deliver_id] );
-        if( opacket.eom && ++deliver_id >= num_workers ) deliver_id = 0;
+        if( opacket.eom ) deliver_ids.pop();
         if( opacket.data ) packet_vector.push_back( opacket );
         }
       }
@@ -145,7 +178,7 @@ out: xunlock( &omutex );
 
   bool finished()		// all packets delivered to muxer
     {
-    if( num_working != 0 ) return false;
+    if( num_working != 0 || !deliver_ids.empty() ) return false;
     for( int i = 0; i < num_workers; ++i )
       if( !opacket_queues[i].empty() ) return false;
     return true;
@@ -160,13 +193,12 @@ struct Worker_arg
   const Pretty_print * pp;
   Shared_retval * shared_retval;
   int infd;
-  int num_workers;
   int worker_id;
   void assign( const Lzip_index & li, Packet_courier & co,
                const Pretty_print & pp_, Shared_retval & sr,
-               const int ifd, const int nw, const int wi )
+               const int ifd, const int wi )
     { lzip_index = &li; courier = &co; pp = &pp_; shared_retval = &sr;
-      infd = ifd; num_workers = nw; worker_id = wi; }
+      infd = ifd; worker_id = wi; }
   };
 
 
@@ -181,19 +213,20 @@ extern "C" void * dworker_o( void * arg )
   const Pretty_print & pp = *tmp.pp;
   Shared_retval & shared_retval = *tmp.shared_retval;
   const int infd = tmp.infd;
-  const int num_workers = tmp.num_workers;
   const int worker_id = tmp.worker_id;
   const int buffer_size = 65536;
 
   int new_pos = 0;
+  bool member_taken = false;		// memory reserved for current member
   uint8_t * new_data = 0;
   uint8_t * const ibuffer = new( std::nothrow ) uint8_t[buffer_size];
   LZ_Decoder * const decoder = LZ_decompress_open();
   if( !ibuffer || !decoder || LZ_decompress_errno( decoder ) != LZ_ok )
     { if( shared_retval.set_value( 1 ) ) { pp( mem_msg ); } goto done; }
 
-  for( long i = worker_id; i < lzip_index.members(); i += num_workers )
+  for( long i; ( i = courier.get_member( worker_id ) ) >= 0; )
     {
+    member_taken = true;
     long long member_pos = lzip_index.mblock( i ).pos();
     long long member_rest = lzip_index.mblock( i ).size();
 
@@ -243,8 +276,10 @@ extern "C" void * dworker_o( void * arg )
         }
       }
     show_progress( lzip_index.mblock( i ).size() );
+    courier.member_done(); member_taken = false;
     }
 done:
+  if( member_taken ) courier.member_done();
   delete[] ibuffer; if( new_data ) delete[] new_data;
   if( LZ_decompress_member_position( decoder ) != 0 &&
       shared_retval.set_value( 1 ) )
@@ -285,11 +320,16 @@ void muxer( Packet_courier & courier, const Pretty_print & pp,
 
 // init the courier, then start the workers and call the muxer
 int dec_stdout( const int num_workers, const int infd, const int outfd,
-                const Pretty_print & pp, const int debug_level,
-                const int out_slots, const Lzip_index & lzip_index )
+                const Cl_options & cl_opts, const Pretty_print & pp,
+                const int debug_level, const int out_slots,
+                const Lzip_index & lzip_index )
   {
+  // decoder, output slots of the worker, and input buffer
+  const unsigned long long mem_per_member = lzip_index.dictionary_size() +
+    (unsigned long long)out_slots * max_packet_size + 65536;
   Shared_retval shared_retval;
-  Packet_courier courier( shared_retval, num_workers, out_slots );
+  Packet_courier courier( shared_retval, lzip_index.members(), num_workers,
+                          out_slots, cl_opts.max_memory, mem_per_member );
 
   Worker_arg * worker_args = new( std::nothrow ) Worker_arg[num_workers];
   pthread_t * worker_threads = new( std::nothrow ) pthread_t[num_workers];
@@ -299,8 +339,7 @@ int dec_stdout( const int num_workers, const int infd, const int outfd,
   int i = 0;				// number of workers started
   for( ; i < num_workers; ++i )
     {
-    worker_args[i].assign( lzip_index, courier, pp, shared_retval, infd,
-                           num_workers, i );
+    worker_args[i].assign( lzip_index, courier, pp, shared_retval, infd, i );
     const int errcode =
       pthread_create( &worker_threads[i], 0, dworker_o, &worker_args[i] );
     if( errcode )
@@ -329,8 +368,10 @@ int dec_stdout( const int num_workers, const int infd, const int outfd,
     std::fprintf( stderr,
       "workers started                           %8u\n"
       "muxer tried to consume from workers       %8u times\n"
-      "muxer had to wait                         %8u times\n",
-      num_workers, courier.ocheck_counter, courier.owait_counter );
+      "muxer had to wait                         %8u times\n"
+      "workers waited for memory                 %8u times\n",
+      num_workers, courier.ocheck_counter, courier.owait_counter,
+      courier.budget.wait_counter );
 
   if( !courier.finished() ) internal_error( "courier not finished." );
   return 0;
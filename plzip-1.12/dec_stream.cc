@@ -54,9 +54,11 @@ struct Packet			// data block
   uint8_t * data;		// data may be null if size == 0
   int size;			// number of bytes in data (if any)
   bool eom;			// end of member
-  Packet() : data( 0 ), size( 0 ), eom( false ) {}
-  Packet( uint8_t * const d, const int s, const bool e )
-    : data( d ), size( s ), eom ( e ) {}
+  unsigned long long mem;	// memory to be released after this packet
+  Packet() : data( 0 ), size( 0 ), eom( false ), mem( 0 ) {}
+  Packet( uint8_t * const d, const int s, const bool e,
+          const unsigned long long m = 0 )
+    : data( d ), size( s ), eom ( e ), mem( m ) {}
   void delete_data() { if( data ) { delete[] data; data = 0; } }
   };
 
@@ -68,7 +70,9 @@ public:
   unsigned iwait_counter;
   unsigned ocheck_counter;
   unsigned owait_counter;
+  Memory_budget budget;			// limits the members in flight
 private:
+  const unsigned long long out_memory;	// output memory reserved per member
   int receive_id;		// worker queue currently receiving packets
   int deliver_id;		// worker queue currently delivering packets
   Slot_tally slot_tally;		// limits the number of input packets
@@ -91,10 +95,13 @@ private:
 
 public:
   Packet_courier( const Shared_retval & sh_ret, const int workers,
-                  const int in_slots, const int oslots )
+                  const int in_slots, const int oslots,
+                  const unsigned long long max_memory,
+                  const unsigned long long out_mem )
     : icheck_counter( 0 ), iwait_counter( 0 ),
-      ocheck_counter( 0 ), owait_counter( 0 ),
-      receive_id( 0 ), deliver_id( 0 ), slot_tally( in_slots ),
+      ocheck_counter( 0 ), owait_counter( 0 ), budget( max_memory ),
+      out_memory( out_mem ), receive_id( 0 ), deliver_id( 0 ),
+      slot_tally( in_slots ),
       ipacket_queues( workers ), opacket_queues( workers ),
       num_working( workers ), num_workers( workers ),
       out_slots( oslots ), slot_av( workers ), shared_retval( sh_ret ),
@@ -120,12 +127,28 @@ public:
     xdestroy_cond( &iav_or_eof ); xdestroy_mutex( &imutex );
     }
 
+  /* Wait until there is memory to decompress a new member, and return the
+     amount reserved. Every member sent before has all its packets queued,
+     so the members in flight can always finish and release memory. */
+  unsigned long long reserve_member( const unsigned dictionary_size )
+    {
+    const unsigned long long size = dictionary_size + out_memory;
+    budget.reserve( size );
+    return size;
+    }
+
+  void release_member( const unsigned long long size )
+    { budget.release( size ); }
+
   /* Make a packet with data received from splitter.
-     If eom == true (end of member), move to next queue. */
-  void receive_packet( uint8_t * const data, const int size, const bool eom )
+     If eom == true (end of member), move to next queue.
+     mem is the memory reserved for the member, released after eom. */
+  void receive_packet( uint8_t * const data, const int size, const bool eom,
+                       const unsigned long long mem = 0 )
     {
-    if( shared_retval() ) { delete[] data; return; } // discard packet on error
-    const Packet ipacket( data, size, eom );
+    if( shared_retval() )			// discard packet on error
+      { delete[] data; budget.release( mem ); return; }
+    const Packet ipacket( data, size, eom, mem );
     slot_tally.get_slot();			// wait for a free slot
     xlock( &imutex );
     ipacket_queues[receive_id].push( ipacket );
@@ -376,6 +399,7 @@ extern "C" void * dworker_s( void * arg )
       if( !ipacket.data || written == ipacket.size ) break;
       }
     ipacket.delete_data();
+    courier.release_member( ipacket.mem );
     }
 
   if( new_data ) delete[] new_data;
@@ -389,6 +413,26 @@ extern "C" void * dworker_s( void * arg )
   }
 
 
+/* Return the position of the first lzip_magic found in buffer at or after
+   pos. A copy of lzip_magic must be present at or after pos as sentinel.
+   memchr is usually vectorized, making the search for the first byte of
+   the magic much faster than a byte-by-byte loop.
+*/
+int find_magic( const uint8_t * const buffer, int pos, const int end )
+  {
+  while( true )
+    {
+    const uint8_t * const p = (const uint8_t *)
+      std::memchr( buffer + pos, lzip_magic[0], end - pos );
+    if( !p ) internal_error( "sentinel not found." );
+    pos = p - buffer;
+    if( p[1] == lzip_magic[1] && p[2] == lzip_magic[2] &&
+        p[3] == lzip_magic[3] ) return pos;
+    ++pos;
+    }
+  }
+
+
 bool start_worker( const Worker_arg & worker_arg,
                    Worker_arg * const worker_args,
                    pthread_t * const worker_threads, const int worker_id,
@@ -459,6 +503,8 @@ fail:
   if( verbosity >= 1 ) pp();
   show_progress( 0, tmp.cfile_size, &pp );			// init
 
+  // memory reserved for the member being split
+  unsigned long long member_mem = courier.reserve_member( tmp.dictionary_size );
   unsigned long long partial_member_size = 0;
   bool worker_pending = true;	// start 1 worker per first packet of member
   while( true )
@@ -468,10 +514,7 @@ fail:
     std::memcpy( buffer + hsize + size, lzip_magic, 4 );	// sentinel
     for( int newpos = 1; newpos <= size; ++newpos )
       {
-      while( buffer[newpos]   != lzip_magic[0] ||
-             buffer[newpos+1] != lzip_magic[1] ||
-             buffer[newpos+2] != lzip_magic[2] ||
-             buffer[newpos+3] != lzip_magic[3] ) ++newpos;
+      newpos = find_magic( buffer, newpos, size + hsize + 4 );
       if( newpos <= size )
         {
         const Lzip_trailer & trailer =
@@ -493,7 +536,7 @@ fail:
           uint8_t * const data = new( std::nothrow ) uint8_t[newpos - pos];
           if( !data ) goto mem_fail;
           std::memcpy( data, buffer + pos, newpos - pos );
-          courier.receive_packet( data, newpos - pos, true );	// eom
+          courier.receive_packet( data, newpos - pos, true, member_mem );
           partial_member_size = 0;
           pos = newpos;
           if( worker_pending )
@@ -502,6 +545,7 @@ fail:
               ++worker_id; }
           worker_pending = worker_id < tmp.num_workers;
           show_progress( member_size );
+          member_mem = courier.reserve_member( dictionary_size );
           }
         }
       }
@@ -511,7 +555,7 @@ fail:
       uint8_t * data = new( std::nothrow ) uint8_t[size + hsize - pos];
       if( !data ) goto mem_fail;
       std::memcpy( data, buffer + pos, size + hsize - pos );
-      courier.receive_packet( data, size + hsize - pos, true );	// eom
+      courier.receive_packet( data, size + hsize - pos, true, member_mem );
       if( worker_pending &&
           start_worker( worker_arg, worker_args, worker_threads,
                         worker_id, shared_retval ) ) ++worker_id;
@@ -579,12 +623,26 @@ int dec_stream( const unsigned long long cfile_size, const int num_workers,
                 const Pretty_print & pp, const int debug_level,
                 const int in_slots, const int out_slots )
   {
-  const int total_in_slots = ( INT_MAX / num_workers >= in_slots ) ?
-                             num_workers * in_slots : INT_MAX;
+  int total_in_slots = ( INT_MAX / num_workers >= in_slots ) ?
+                       num_workers * in_slots : INT_MAX;
+  unsigned long long max_memory = cl_opts.max_memory;
+  if( max_memory > 0 )		// use at most 1/4 of max_memory for input
+    {
+    const unsigned long long in_memory_slots = std::max(
+      (unsigned long long)in_slots, max_memory / 4 / max_packet_size );
+    if( (unsigned long long)total_in_slots > in_memory_slots )
+      total_in_slots = in_memory_slots;
+    const unsigned long long in_memory =
+      (unsigned long long)total_in_slots * max_packet_size;
+    max_memory = ( max_memory > in_memory ) ? max_memory - in_memory : 1;
+    }
+  const unsigned long long out_memory = ( outfd < 0 ) ? 0 :
+    (unsigned long long)out_slots * max_packet_size;
   in_size = 0;
   out_size = 0;
   Shared_retval shared_retval;
-  Packet_courier courier( shared_retval, num_workers, total_in_slots, out_slots );
+  Packet_courier courier( shared_retval, num_workers, total_in_slots,
+                          out_slots, max_memory, out_memory );
 
   if( debug_level & 2 ) std::fputs( "decompress stream.\n", stderr );
 
@@ -633,9 +691,10 @@ int dec_stream( const unsigned long long cfile_size, const int num_workers,
     std::fprintf( stderr,
       "workers started                           %8u\n"
       "any worker tried to consume from splitter %8u times\n"
-      "any worker had to wait                    %8u times\n",
-      splitter_arg.num_workers,
-      courier.icheck_counter, courier.iwait_counter );
+      "any worker had to wait                    %8u times\n"
+      "splitter waited for memory                %8u times\n",
+      splitter_arg.num_workers, courier.icheck_counter,
+      courier.iwait_counter, courier.budget.wait_counter );
     if( outfd >= 0 )
       std::fprintf( stderr,
         "muxer tried to consume from workers       %8u times\n"
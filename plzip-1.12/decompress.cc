@@ -153,21 +153,67 @@ void show_results( const unsigned long long in_size,
 
 namespace {
 
+/* Hand out members to workers one at a time, largest first, so that a
+   worker finishing a small member takes the next pending one instead of
+   waiting for its turn in a fixed round-robin assignment.
+   Members of equal size are handed out in file order.
+*/
+class Member_queue
+  {
+  struct Larger_member
+    {
+    const Lzip_index & lzip_index;
+    explicit Larger_member( const Lzip_index & li ) : lzip_index( li ) {}
+    bool operator()( const long i, const long j ) const
+      { return lzip_index.mblock( i ).size() > lzip_index.mblock( j ).size(); }
+    };
+
+  std::vector< long > order;		// member indices, largest first
+  unsigned long next;			// index in order of next member
+  pthread_mutex_t mutex;
+
+  Member_queue( const Member_queue & );		// declared as private
+  void operator=( const Member_queue & );	// declared as private
+
+public:
+  explicit Member_queue( const Lzip_index & lzip_index )
+    : order( lzip_index.members() ), next( 0 )
+    {
+    for( unsigned long i = 0; i < order.size(); ++i ) order[i] = i;
+    std::stable_sort( order.begin(), order.end(),
+                      Larger_member( lzip_index ) );
+    xinit_mutex( &mutex );
+    }
+
+  ~Member_queue() { xdestroy_mutex( &mutex ); }
+
+  long get_member()		// return -1 if no members are left
+    {
+    xlock( &mutex );
+    const long i = ( next < order.size() ) ? order[next++] : -1;
+    xunlock( &mutex );
+    return i;
+    }
+  };
+
+
 struct Worker_arg
   {
   const Lzip_index * lzip_index;
+  Member_queue * member_queue;
+  Memory_budget * budget;
   const Pretty_print * pp;
   Shared_retval * shared_retval;
   int infd;
-  int num_workers;
   int outfd;
   int worker_id;
   bool nocopy;		// avoid copying decompressed data when testing
-  void assign( const Lzip_index & li, const Pretty_print & pp_,
-               Shared_retval & sr, const int ifd, const int nw,
+  void assign( const Lzip_index & li, Member_queue & mq, Memory_budget & mb,
+               const Pretty_print & pp_, Shared_retval & sr, const int ifd,
                const int ofd, const int wi, const bool nc )
-    { lzip_index = &li; pp = &pp_; shared_retval = &sr; infd = ifd;
-      num_workers = nw; outfd = ofd; worker_id = wi; nocopy = nc; }
+    { lzip_index = &li; member_queue = &mq; budget = &mb; pp = &pp_;
+      shared_retval = &sr; infd = ifd; outfd = ofd; worker_id = wi;
+      nocopy = nc; }
   };
 
 
@@ -178,14 +224,16 @@ extern "C" void * dworker( void * arg )
   {
   const Worker_arg & tmp = *(const Worker_arg *)arg;
   const Lzip_index & lzip_index = *tmp.lzip_index;
+  Member_queue & member_queue = *tmp.member_queue;
+  Memory_budget & budget = *tmp.budget;
   const Pretty_print & pp = *tmp.pp;
   Shared_retval & shared_retval = *tmp.shared_retval;
   const int worker_id = tmp.worker_id;
-  const int num_workers = tmp.num_workers;
   const int infd = tmp.infd;
   const int outfd = tmp.outfd;
   const bool nocopy = tmp.nocopy;
   const int buffer_size = 65536;
+  unsigned long long reserved = 0;	// memory reserved for current member
 
   uint8_t * const ibuffer = new( std::nothrow ) uint8_t[buffer_size];
   uint8_t * const obuffer =
@@ -195,8 +243,10 @@ extern "C" void * dworker( void * arg )
       LZ_decompress_errno( decoder ) != LZ_ok )
     { if( shared_retval.set_value( 1 ) ) { pp( mem_msg ); } goto done; }
 
-  for( long i = worker_id; i < lzip_index.members(); i += num_workers )
+  for( long i; ( i = member_queue.get_member() ) >= 0; )
     {
+    reserved = lzip_index.dictionary_size( i ) + 2ULL * buffer_size;
+    budget.reserve( reserved );
     long long data_pos = lzip_index.dblock( i ).pos();
     long long data_rest = lzip_index.dblock( i ).size();
     long long member_pos = lzip_index.mblock( i ).pos();
@@ -255,8 +305,10 @@ extern "C" void * dworker( void * arg )
         }
       }
     show_progress( lzip_index.mblock( i ).size() );
+    budget.release( reserved ); reserved = 0;
     }
 done:
+  budget.release( reserved );
   if( obuffer ) { delete[] obuffer; } delete[] ibuffer;
   if( LZ_decompress_member_position( decoder ) != 0 &&
       shared_retval.set_value( 1 ) )
@@ -306,8 +358,8 @@ int decompress( const unsigned long long cfile_size, int num_workers,
       if( debug_level & 2 ) std::fputs( "decompress file to stdout.\n", stderr );
       if( verbosity >= 1 ) pp();
       show_progress( 0, cfile_size, &pp );			// init
-      const int tmp = dec_stdout( num_workers, infd, outfd, pp, debug_level,
-                                  out_slots, lzip_index );
+      const int tmp = dec_stdout( num_workers, infd, outfd, cl_opts, pp,
+                                  debug_level, out_slots, lzip_index );
       if( tmp ) return tmp;
       if( multi_empty ) { show_file_error( pp.name(), empty_msg ); return 2; }
       return 0;
@@ -329,12 +381,14 @@ int decompress( const unsigned long long cfile_size, int num_workers,
   const bool nocopy = false;
 #endif
 
+  Member_queue member_queue( lzip_index );
+  Memory_budget budget( cl_opts.max_memory );
   Shared_retval shared_retval;
   int i = 0;				// number of workers started
   for( ; i < num_workers; ++i )
     {
-    worker_args[i].assign( lzip_index, pp, shared_retval, infd, num_workers,
-                           outfd, i, nocopy );
+    worker_args[i].assign( lzip_index, member_queue, budget, pp,
+                           shared_retval, infd, outfd, i, nocopy );
     const int errcode =
       pthread_create( &worker_threads[i], 0, dworker, &worker_args[i] );
     if( errcode )
@@ -359,7 +413,9 @@ int decompress( const unsigned long long cfile_size, int num_workers,
 
   if( debug_level & 1 )
     std::fprintf( stderr,
-      "workers started                           %8u\n", num_workers );
+      "workers started                           %8u\n"
+      "workers waited for memory                 %8u times\n",
+      num_workers, budget.wait_counter );
 
   if( multi_empty ) { show_file_error( pp.name(), empty_msg ); return 2; }
   return 0;
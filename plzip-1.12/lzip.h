@@ -194,10 +194,14 @@ struct Lzip_trailer
 
 struct Cl_options		// command-line options
   {
+  unsigned long long max_memory;	// memory limit for decompression
+  bool direct_io;			// read input with O_DIRECT
   bool ignore_trailing;
   bool loose_trailing;
 
-  Cl_options() : ignore_trailing( true ), loose_trailing( false ) {}
+  Cl_options()
+    : max_memory( 0 ), direct_io( false ), ignore_trailing( true ),
+      loose_trailing( false ) {}
   };
 
 
@@ -227,16 +231,18 @@ void xbroadcast( pthread_cond_t * const cond );
 int compress( const unsigned long long cfile_size,
               const int data_size, const int dictionary_size,
               const int match_len_limit, const int num_workers,
-              const int infd, const int outfd,
-              const Pretty_print & pp, const int debug_level );
+              const int slots_per_worker, const int infd, const int outfd,
+              const Cl_options & cl_opts, const Pretty_print & pp,
+              const int debug_level );
 
 // defined in lzip_index.cc
 class Lzip_index;				// forward declaration
 
 // defined in dec_stdout.cc
 int dec_stdout( const int num_workers, const int infd, const int outfd,
-                const Pretty_print & pp, const int debug_level,
-                const int out_slots, const Lzip_index & lzip_index );
+                const Cl_options & cl_opts, const Pretty_print & pp,
+                const int debug_level, const int out_slots,
+                const Lzip_index & lzip_index );
 
 // defined in dec_stream.cc
 int dec_stream( const unsigned long long cfile_size, const int num_workers,
@@ -318,6 +324,52 @@ public:
   };
 
 
+/* Limits the memory used by the members being decompressed. A member is
+   always admitted if no memory is reserved, so that it can progress even
+   if it alone exceeds the limit.
+*/
+class Memory_budget
+  {
+public:
+  unsigned wait_counter;			// times a reservation waited
+private:
+  const unsigned long long limit;		// 0 means no limit
+  unsigned long long used;			// memory currently reserved
+  pthread_mutex_t mutex;
+  pthread_cond_t mem_av;			// memory released
+
+  Memory_budget( const Memory_budget & );	// declared as private
+  void operator=( const Memory_budget & );	// declared as private
+
+public:
+  explicit Memory_budget( const unsigned long long lim )
+    : wait_counter( 0 ), limit( lim ), used( 0 )
+    { xinit_mutex( &mutex ); xinit_cond( &mem_av ); }
+
+  ~Memory_budget() { xdestroy_cond( &mem_av ); xdestroy_mutex( &mutex ); }
+
+  void reserve( const unsigned long long size )	// wait for enough memory
+    {
+    if( limit == 0 || size == 0 ) return;
+    xlock( &mutex );
+    if( used > 0 && used + size > limit )
+      { ++wait_counter;
+        do xwait( &mem_av, &mutex ); while( used > 0 && used + size > limit ); }
+    used += size;
+    xunlock( &mutex );
+    }
+
+  void release( const unsigned long long size )
+    {
+    if( limit == 0 || size == 0 ) return;
+    xlock( &mutex );
+    used -= size;
+    xbroadcast( &mem_av );
+    xunlock( &mutex );
+    }
+  };
+
+
 class Shared_retval		// shared return value protected by a mutex
   {
   int retval;
@@ -129,7 +129,7 @@ void show_help( const long num_online )
                "  -h, --help                     display this help and exit\n"
                "  -V, --version                  output version information and exit\n"
                "  -a, --trailing-error           exit with error status if trailing data\n"
-               "  -B, --data-size=<bytes>        set size of input data blocks [2x8=16 MiB]\n"
+               "  -B, --data-size=<bytes|auto>   set size of input data blocks [2x8=16 MiB]\n"
                "  -c, --stdout                   write to standard output, keep input files\n"
                "  -d, --decompress               decompress, test compressed file integrity\n"
                "  -f, --force                    overwrite existing output files\n"
@@ -147,7 +147,9 @@ void show_help( const long num_online )
                "      --fast                     alias for -0\n"
                "      --best                     alias for -9\n"
                "      --loose-trailing           allow trailing data seeming corrupt header\n"
-               "      --in-slots=<n>             number of 1 MiB input packets buffered [4]\n"
+               "      --max-memory=<bytes>       limit memory used to decompress (approximate)\n"
+               "      --direct-io                read input files bypassing the page cache\n"
+               "      --in-slots=<n>             input packets buffered per thread [c:2 d:4]\n"
                "      --out-slots=<n>            number of 1 MiB output packets buffered [64]\n"
                "      --check-lib                compare version of lzlib.h with liblz.{a,so}\n",
                num_online );
@@ -764,9 +766,10 @@ int main( const int argc, const char * const argv[] )
   Lzma_options encoder_options = option_mapping[6];	// default = "-6"
   std::string default_output_filename;
   int data_size = 0;
+  bool auto_data_size = false;	// adapt data_size to size of input file
   int debug_level = 0;
   int num_workers = 0;		// start this many worker threads
-  int in_slots = 4;
+  int in_slots = 0;		// 0 = default, 2 to compress, 4 to decompress
   int out_slots = 64;
   Mode program_mode = m_compress;
   Cl_options cl_opts;		// command-line options
@@ -776,7 +779,7 @@ int main( const int argc, const char * const argv[] )
   bool to_stdout = false;
   if( argc > 0 ) invocation_name = argv[0];
 
-  enum { opt_chk = 256, opt_dbg, opt_in, opt_lt, opt_out };
+  enum { opt_chk = 256, opt_dbg, opt_dio, opt_in, opt_lt, opt_mm, opt_out };
   const Arg_parser::Option options[] =
     {
     { '0', "fast",              Arg_parser::no  },
@@ -810,8 +813,10 @@ int main( const int argc, const char * const argv[] )
     { 'V', "version",           Arg_parser::no  },
     { opt_chk, "check-lib",     Arg_parser::no  },
     { opt_dbg, "debug",         Arg_parser::yes },
+    { opt_dio, "direct-io",     Arg_parser::no  },
     { opt_in, "in-slots",       Arg_parser::yes },
     { opt_lt, "loose-trailing", Arg_parser::no  },
+    { opt_mm, "max-memory",     Arg_parser::yes },
     { opt_out, "out-slots",     Arg_parser::yes },
     { 0, 0,                     Arg_parser::no  } };
 
@@ -839,8 +844,10 @@ int main( const int argc, const char * const argv[] )
                 encoder_options = option_mapping[code-'0']; break;
       case 'a': cl_opts.ignore_trailing = false; break;
       case 'b': break;					// ignored
-      case 'B': data_size = getnum( arg, pn, 2 * LZ_min_dictionary_size(),
-                                    2 * LZ_max_dictionary_size() ); break;
+      case 'B': if( sarg == "auto" ) { auto_data_size = true; break; }
+                data_size = getnum( arg, pn, 2 * LZ_min_dictionary_size(),
+                                    2 * LZ_max_dictionary_size() );
+                auto_data_size = false; break;
       case 'c': to_stdout = true; break;
       case 'd': set_mode( program_mode, m_decompress ); break;
       case 'f': force = true; break;
@@ -863,8 +870,11 @@ int main( const int argc, const char * const argv[] )
       case 'V': show_version(); return 0;
       case opt_chk: return check_lib();
       case opt_dbg: debug_level = getnum( arg, pn, 0, 3 ); break;
+      case opt_dio: cl_opts.direct_io = true; break;
       case opt_in: in_slots = getnum( arg, pn, 1, 64 ); break;
       case opt_lt: cl_opts.loose_trailing = true; break;
+      case opt_mm: cl_opts.max_memory = getnum( arg, pn, 1 << 20, LLONG_MAX );
+                   break;
       case opt_out: out_slots = getnum( arg, pn, 1, 1024 ); break;
       default: internal_error( "uncaught option." );
       }
@@ -984,13 +994,33 @@ int main( const int argc, const char * const argv[] )
       infd_isreg ? ( in_stats.st_size + 99 ) / 100 : 0;
     int tmp;
     if( program_mode == m_compress )
-      tmp = compress( cfile_size, data_size, encoder_options.dictionary_size,
+      {
+      int file_data_size = data_size;
+      int dictionary_size = encoder_options.dictionary_size;
+      if( auto_data_size && infd_isreg )  // give each worker a packet or more
+        {
+        const int min_data_size = std::min( data_size, 1 << 20 );
+        const long long wsize =
+          ( in_stats.st_size + num_workers - 1 ) / num_workers;
+        if( wsize < file_data_size )		// round up to 64 KiB
+          file_data_size = std::min( (long long)file_data_size, std::max(
+            (long long)min_data_size, ( wsize + 0xFFFF ) & ~0xFFFFLL ) );
+        if( !fast && file_data_size < dictionary_size )
+          dictionary_size =
+            std::max( file_data_size, LZ_min_dictionary_size() );
+        if( debug_level & 2 )
+          std::fprintf( stderr, "data size %d, dictionary size %d.\n",
+                        file_data_size, dictionary_size );
+        }
+      tmp = compress( cfile_size, file_data_size, dictionary_size,
                       encoder_options.match_len_limit, num_workers,
-                      infd, outfd, pp, debug_level );
+                      ( in_slots > 0 ) ? in_slots : 2, infd, outfd, cl_opts,
+                      pp, debug_level );
+      }
     else
       tmp = decompress( cfile_size, num_workers, infd, outfd, cl_opts, pp,
-                        debug_level, in_slots, out_slots, from_stdin,
-                        infd_isreg, one_to_one );
+                        debug_level, ( in_slots > 0 ) ? in_slots : 4,
+                        out_slots, from_stdin, infd_isreg, one_to_one );
     if( close( infd ) != 0 )
       { show_file_error( pp.name(), "Error closing input file", errno );
         set_retval( tmp, 1 ); }
@@ -208,6 +208,14 @@ void Archive_reader_i::set_member( const long i )
    Return value: 0 = OK, 1 = OOM or read error, 2 = EOF or invalid data. */
 int Archive_reader_i::read( uint8_t * const buf, const int size )
   {
+  if( !decoder )					// uncompressed
+    {
+    const int rd = preadblock( ad.infd, buf, size, archive_pos );
+    archive_pos += rd; data_pos_ += rd;
+    if( rd == size ) return 0;
+    if( errno ) return err( -1, rdaerr_msg, errno, rd );
+    return err( -2, end_msg, 0, rd );
+    }
   int sz = 0;
 
   while( sz < size )
@@ -250,6 +258,8 @@ int Archive_reader_i::skip_member( const Extended & extended )
   if( extended.file_size() <= 0 ) return 0;
   long long rest = round_up( extended.file_size() );	// size + padding
   if( data_pos_ + rest == mdata_end_ ) { data_pos_ = mdata_end_; return 0; }
+  if( !decoder )				// uncompressed
+    { data_pos_ += rest; archive_pos += rest; return 0; }
   const int bufsize = 32 * header_size;
   uint8_t buf[bufsize];
   while( rest > 0 )				// skip tar member
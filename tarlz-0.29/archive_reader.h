@@ -90,7 +90,8 @@ public:
 
 /* If the archive is compressed seekable (indexed), several indexed readers
    can be constructed sharing the same Archive_descriptor, for example to
-   decode the archive in parallel.
+   decode the archive in parallel. If the archive is uncompressed seekable,
+   the readers read blocks of whole tar members found by index_tar.
 */
 class Archive_reader_i : public Archive_reader_base	// indexed reader
   {
@@ -104,6 +105,7 @@ public:
     : Archive_reader_base( d ),
       data_pos_( 0 ), mdata_end_( 0 ), archive_pos( 0 ), member_id( 0 )
     {
+    if( !ad.indexed ) return;			// uncompressed
     decoder = LZ_decompress_open();
     if( !decoder || LZ_decompress_errno( decoder ) != LZ_ok )
       { LZ_decompress_close( decoder ); decoder = 0; fatal_ = true; }
@@ -115,6 +117,9 @@ public:
 
   // Reset decoder and set position to the start of the member.
   void set_member( const long i );
+  // Set position to the start of a block of an uncompressed archive.
+  void set_block( const Block & b )
+    { data_pos_ = archive_pos = b.pos(); mdata_end_ = b.end(); }
 
   int read( uint8_t * const buf, const int size );
   int skip_member( const Extended & extended );
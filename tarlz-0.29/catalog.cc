@@ -0,0 +1,219 @@
+/* Tarlz - Archiver with multimember lzip compression
+   Copyright (C) 2013-2026 Antonio Diaz Diaz.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _FILE_OFFSET_BITS 64
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "tarlz.h"
+#include "arg_parser.h"
+#include "lzip_index.h"
+#include "decode.h"
+#include "catalog.h"
+
+
+/* Catalog file format (all integers are little endian):
+   magic "TZCT", version (1 byte), number of data members (8 bytes),
+   compressed size of each data member (8 bytes each),
+   number of entries (8 bytes), entries sorted by name, CRC32-C (4 bytes).
+   Each entry: member (8 bytes), file size (8 bytes), typeflag (1 byte),
+   name size (4 bytes), name.
+   The archive must contain exactly one member (the EOA member) after the
+   data members. */
+
+namespace {
+
+const uint8_t catalog_magic[4] = { 'T', 'Z', 'C', 'T' };
+const uint8_t catalog_version = 1;
+enum { fixed_entry_size = 8 + 8 + 1 + 4,
+       min_catalog_size = 4 + 1 + 8 + 8 + 4 };
+
+void put_le( std::string & buf, unsigned long long num, const int size )
+  {
+  for( int i = 0; i < size; ++i ) { buf += (char)( num & 0xFF ); num >>= 8; }
+  }
+
+unsigned long long get_le( const uint8_t * const buf, const int size )
+  {
+  unsigned long long num = 0;
+  for( int i = size - 1; i >= 0; --i ) { num <<= 8; num += buf[i]; }
+  return num;
+  }
+
+uint32_t compute_crc( const uint8_t * const buffer, const unsigned long size )
+  {
+  uint32_t crc = 0xFFFFFFFFU;
+  for( unsigned long pos = 0; pos < size; )
+    {
+    const int chunk = std::min( size - pos, 1UL << 30 );
+    crc32c.update_buf( crc, buffer + pos, chunk );
+    pos += chunk;
+    }
+  return crc ^ 0xFFFFFFFFU;
+  }
+
+
+// compare the name of entry at pos with key, at most key_size bytes
+int compare_prefix( const uint8_t * const buffer, const unsigned long pos,
+                    const char * const key, const int key_size )
+  {
+  const int name_size = get_le( buffer + pos + 17, 4 );
+  const int diff = std::memcmp( buffer + pos + fixed_entry_size, key,
+                                std::min( name_size, key_size ) );
+  if( diff != 0 || name_size >= key_size ) return diff;
+  return -1;
+  }
+
+} // end namespace
+
+
+// write the catalog to outfd and close outfd
+bool write_catalog( const std::string & name, const int outfd,
+                    std::vector< Catalog_entry > & entries,
+                    const std::vector< long long > & member_sizes )
+  {
+  std::sort( entries.begin(), entries.end() );
+  std::string buf( (const char *)catalog_magic, sizeof catalog_magic );
+  buf += (char)catalog_version;
+  put_le( buf, member_sizes.size(), 8 );
+  for( unsigned long i = 0; i < member_sizes.size(); ++i )
+    put_le( buf, member_sizes[i], 8 );
+  put_le( buf, entries.size(), 8 );
+  for( unsigned long i = 0; i < entries.size(); ++i )
+    {
+    const Catalog_entry & entry = entries[i];
+    put_le( buf, entry.member, 8 );
+    put_le( buf, entry.file_size, 8 );
+    buf += (char)entry.typeflag;
+    put_le( buf, entry.name.size(), 4 );
+    buf += entry.name;
+    }
+  put_le( buf, compute_crc( (const uint8_t *)buf.data(), buf.size() ), 4 );
+
+  const uint8_t * const data = (const uint8_t *)buf.data();
+  for( unsigned long pos = 0; pos < buf.size(); )
+    {
+    const int size = std::min( buf.size() - pos, 1UL << 30 );
+    if( writeblock( outfd, data + pos, size ) != size )
+      { show_file_error( name.c_str(), wr_err_msg, errno );
+        close( outfd ); return false; }
+    pos += size;
+    }
+  if( close( outfd ) != 0 )
+    { show_file_error( name.c_str(), "Error closing catalog", errno );
+      return false; }
+  return true;
+  }
+
+
+/* Read the catalog from infd and close infd.
+   Fill 'members' with the numbers of the lzip members containing the names
+   in cl_names, plus the EOA member. Return false (and leave 'members'
+   empty) if the catalog can't be read or does not match the archive.
+*/
+bool read_catalog( const int infd, const char * const name,
+                   const Lzip_index & lzip_index, const Cl_names & cl_names,
+                   const bool recursive, std::vector< long > & members )
+  {
+  members.clear();
+  struct stat st;
+  const unsigned long size = ( fstat( infd, &st ) == 0 ) ? st.st_size : 0;
+  uint8_t * const buffer =
+    ( size >= min_catalog_size && size == (unsigned long long)st.st_size ) ?
+    new( std::nothrow ) uint8_t[size] : 0;
+  const bool good = buffer && readblock( infd, buffer, size ) == (long)size;
+  close( infd );
+  if( !good )
+    { if( buffer ) delete[] buffer;
+      show_file_error( name, "Can't read catalog." ); return false; }
+
+  const char * msg = 0;
+  unsigned long long num_members = 0, num_entries = 0;
+  unsigned long pos = 5;
+  if( std::memcmp( buffer, catalog_magic, sizeof catalog_magic ) != 0 ||
+      buffer[4] != catalog_version ||
+      get_le( buffer + size - 4, 4 ) != compute_crc( buffer, size - 4 ) )
+    msg = "Bad magic number or CRC in catalog.";
+  else if( ( num_members = get_le( buffer + pos, 8 ) ) >
+           ( size - min_catalog_size ) / 8 ) msg = "Corrupt catalog.";
+  else if( (long long)num_members + 1 != lzip_index.members() )
+    msg = "Catalog does not match the archive.";
+  else
+    {
+    pos += 8;
+    for( unsigned long i = 0; i < num_members; ++i, pos += 8 )
+      if( (long long)get_le( buffer + pos, 8 ) !=
+          lzip_index.mblock( i ).size() )
+        { msg = "Catalog does not match the archive."; break; }
+    }
+  std::vector< unsigned long > entry_pos;
+  if( !msg )
+    {
+    num_entries = get_le( buffer + pos, 8 ); pos += 8;
+    if( num_entries > ( size - pos ) / fixed_entry_size )
+      msg = "Corrupt catalog.";
+    else entry_pos.reserve( num_entries );
+    }
+  for( unsigned long i = 0; !msg && i < num_entries; ++i )
+    {
+    if( pos + fixed_entry_size > size - 4 ) { msg = "Corrupt catalog."; break; }
+    entry_pos.push_back( pos );
+    pos += fixed_entry_size + get_le( buffer + pos + 17, 4 );
+    if( pos > size - 4 ||
+        get_le( buffer + entry_pos.back(), 8 ) >= num_members )
+      msg = "Corrupt catalog.";
+    }
+  if( msg )
+    { delete[] buffer; show_file_error( name, msg ); return false; }
+
+  /* For each name in the command line, test the entries starting with it.
+     Entries whose name matches any name in cl_names select their member. */
+  std::vector< bool > selected( num_members + 1, false );
+  selected[num_members] = true;		// EOA member
+  const std::vector< Cl_names::Name_entry > & name_index = cl_names.name_index;
+  std::string entry_name;
+  for( unsigned long i = 0; i < name_index.size(); ++i )
+    {
+    const Cl_names::Name_entry & e = name_index[i];
+    if( i > 0 && e.key_size == name_index[i-1].key_size &&
+        std::memcmp( e.name, name_index[i-1].name, e.key_size ) == 0 ) continue;
+    unsigned long l = 0, r = entry_pos.size();
+    while( l < r )				// binary search
+      {
+      const unsigned long m = l + ( r - l ) / 2;
+      if( compare_prefix( buffer, entry_pos[m], e.name, e.key_size ) < 0 )
+        l = m + 1; else r = m;
+      }
+    for( ; l < entry_pos.size() &&
+         compare_prefix( buffer, entry_pos[l], e.name, e.key_size ) == 0; ++l )
+      {
+      const uint8_t * const p = buffer + entry_pos[l];
+      entry_name.assign( (const char *)p + fixed_entry_size,
+                         get_le( p + 17, 4 ) );
+      if( cl_names.find_name( entry_name.c_str(), recursive ) )
+        selected[get_le( p, 8 )] = true;
+      }
+    }
+  delete[] buffer;
+  for( unsigned long i = 0; i < selected.size(); ++i )
+    if( selected[i] ) members.push_back( i );
+  return true;
+  }
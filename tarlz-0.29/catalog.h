@@ -0,0 +1,42 @@
+/* Tarlz - Archiver with multimember lzip compression
+   Copyright (C) 2013-2026 Antonio Diaz Diaz.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* A catalog is a file, separate from the archive, listing the tar members
+   of a multimember compressed archive sorted by name. It allows decoding
+   only the lzip members containing the files named in the command line. */
+
+struct Catalog_entry
+  {
+  std::string name;		// tar member name
+  long long member;		// number of the lzip member containing it
+  long long file_size;
+  uint8_t typeflag;
+
+  bool operator<( const Catalog_entry & e ) const
+    { return name < e.name || ( name == e.name && member < e.member ); }
+  };
+
+class Lzip_index;
+struct Cl_names;
+
+// defined in catalog.cc
+bool write_catalog( const std::string & name, const int outfd,
+                    std::vector< Catalog_entry > & entries,
+                    const std::vector< long long > & member_sizes );
+bool read_catalog( const int infd, const char * const name,
+                   const Lzip_index & lzip_index, const Cl_names & cl_names,
+                   const bool recursive, std::vector< long > & members );
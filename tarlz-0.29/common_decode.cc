@@ -17,14 +17,17 @@
 
 #define _FILE_OFFSET_BITS 64
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdio>
 #include <ctime>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
 #include "tarlz.h"
 #include "arg_parser.h"
+#include "common_mutex.h"
 #include "decode.h"
 
 
@@ -169,6 +172,19 @@ const char * read_t_list( const char * const cl_filename, long * const file_size
   return (const char *)buffer;
   }
 
+
+// remove trailing slashes from the name of a directory
+std::string dir_key( const char * const name )
+  {
+  unsigned len = std::strlen( name );
+  while( len > 1 && name[len-1] == '/' ) --len;
+  return std::string( name, len );
+  }
+
+
+bool larger_name( const Dir_metadata & md1, const Dir_metadata & md2 )
+  { return md1.name > md2.name; }
+
 } // end namespace
 
 
@@ -262,64 +278,51 @@ bool check_skip_filename( const Cl_options & cl_opts, Cl_names & cl_names,
   static int c_idx = -1;		// parser index of last -C executed
   if( Exclude::excluded( filename ) ) return true;	// skip excluded files
   if( cl_opts.num_files == 0 && !cl_opts.option_T_present ) return false;
-  bool skip = true;	// else skip all but the files (or trees) specified
-  bool chdir_pending = false;
+  // else skip all but the files (or trees) specified
+  const Cl_names::Name_entry * const entry =
+    cl_names.find_name( filename, cl_opts.recursive );
+  if( !entry ) return true;
 
   const Arg_parser & parser = cl_opts.parser;
-  for( int i = 0; i < parser.arguments(); ++i )
+  const int i = entry->arg_idx;
+  std::string removed_prefix;			// prefix of cl argument
+  if( parser.code( i ) == 'T' )
     {
-    if( parser.code( i ) == 'C' ) { chdir_pending = true; continue; }
-    if( !nonempty_arg( parser, i ) && parser.code( i ) != 'T' ) continue;
-    std::string removed_prefix;			// prefix of cl argument
-    bool match = false;
-    if( parser.code( i ) == 'T' )
-      {
-      T_names & t_names = cl_names.t_names( i );
-      for( unsigned j = 0; j < t_names.names(); ++j )
-        {
-        const char * const name =
-          remove_leading_dotslash( t_names.name( j ), &removed_prefix );
-        if( ( cl_opts.recursive && compare_prefix_dir( name, filename ) ) ||
-            compare_tslash( name, filename ) )
-          { match = true; t_names.reset_name_pending( j ); break; }
-        }
-      }
-    else
-      {
-      const char * const name =
-        remove_leading_dotslash( parser.argument( i ).c_str(), &removed_prefix );
-      if( ( cl_opts.recursive && compare_prefix_dir( name, filename ) ) ||
-          compare_tslash( name, filename ) )
-        { match = true; cl_names.name_pending_or_idx[i] = false; }
-      }
-    if( match )
+    T_names & t_names = cl_names.t_names( i );
+    remove_leading_dotslash( t_names.name( entry->name_idx ), &removed_prefix );
+    t_names.reset_name_pending( entry->name_idx );
+    }
+  else
+    {
+    remove_leading_dotslash( parser.argument( i ).c_str(), &removed_prefix );
+    cl_names.name_pending_or_idx[i] = false;
+    }
+  print_removed_prefix( removed_prefix, msgp );
+  const bool chdir_pending =
+    cl_names.first_chdir_idx >= 0 && cl_names.first_chdir_idx < i;
+  // only serial decoder sets cwd_fd >= 0 to process -C options
+  if( chdir_pending && cwd_fd >= 0 )
+    {
+    if( c_idx > i )
+      { if( fchdir( cwd_fd ) != 0 )
+        { show_error( "Error changing to initial working directory", errno );
+          throw Chdir_error(); } c_idx = -1; }
+    for( int j = c_idx + 1; j < i; ++j )
       {
-      print_removed_prefix( removed_prefix, msgp );
-      skip = false;
-      // only serial decoder sets cwd_fd >= 0 to process -C options
-      if( chdir_pending && cwd_fd >= 0 )
-        {
-        if( c_idx > i )
-          { if( fchdir( cwd_fd ) != 0 )
-            { show_error( "Error changing to initial working directory", errno );
-              throw Chdir_error(); } c_idx = -1; }
-        for( int j = c_idx + 1; j < i; ++j )
-          {
-          if( parser.code( j ) != 'C' ) continue;
-          const char * const dir = parser.argument( j ).c_str();
-          if( chdir( dir ) != 0 )
-            { show_file_error( dir, chdir_msg, errno ); throw Chdir_error(); }
-          c_idx = j;
-          }
-        }
-      break;
+      if( parser.code( j ) != 'C' ) continue;
+      const char * const dir = parser.argument( j ).c_str();
+      if( chdir( dir ) != 0 )
+        { show_file_error( dir, chdir_msg, errno ); throw Chdir_error(); }
+      c_idx = j;
       }
     }
-  return skip;
+  return false;
   }
 
 
-bool make_dirs( const std::string & name )
+// if 'created' is not null, add to it the names of the dirs created
+bool make_dirs( const std::string & name,
+                std::vector< std::string > * const created )
   {
   int i = name.size();
   while( i > 0 && name[i-1] == '/' ) --i;	// remove trailing slashes
@@ -342,7 +345,9 @@ bool make_dirs( const std::string & name )
       const mode_t mode = S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH;
       if( lstat( partial.c_str(), &st ) == 0 )
         { if( !S_ISDIR( st.st_mode ) ) { errno = ENOTDIR; return false; } }
-      else if( mkdir( partial.c_str(), mode ) != 0 && errno != EEXIST )
+      else if( mkdir( partial.c_str(), mode ) == 0 )
+        { if( created ) created->push_back( partial ); }
+      else if( errno != EEXIST )
         return false;	// if EEXIST, another thread or process created the dir
       }
     }
@@ -350,6 +355,83 @@ bool make_dirs( const std::string & name )
   }
 
 
+Dir_registry::Dir_registry() { xinit_mutex( &mutex ); }
+Dir_registry::~Dir_registry() { xdestroy_mutex( &mutex ); }
+
+
+/* Create the intermediate directories of 'filename'.
+   The lock is only needed if some directory must be created. */
+bool Dir_registry::make_dirs( const std::string & filename )
+  {
+  int i = filename.size();
+  while( i > 0 && filename[i-1] == '/' ) --i;	// remove trailing slashes
+  while( i > 0 && filename[i-1] != '/' ) --i;	// remove last component
+  while( i > 0 && filename[i-1] == '/' ) --i;	// remove more slashes
+  struct stat st;
+  if( i == 0 || ( lstat( std::string( filename, 0, i ).c_str(), &st ) == 0 &&
+                  S_ISDIR( st.st_mode ) ) ) return true;
+  xlock( &mutex );
+  const bool ok = ::make_dirs( filename, &created );
+  names.insert( created.begin(), created.end() ); created.clear();
+  xunlock( &mutex );
+  return ok;
+  }
+
+
+/* Create directory 'name' (relative to 'dirfd') of path 'filename'.
+   Set 'made' to true if it was created by this run. Return false if error. */
+bool Dir_registry::make_dir( const int dirfd, const char * const name,
+                             const char * const filename, const mode_t mode,
+                             bool & made )
+  {
+  const std::string k = dir_key( filename );
+  xlock( &mutex );
+  made = names.count( k );
+  bool ok = true;
+  if( !made )
+    {
+    if( mkdirat( dirfd, name, mode ) == 0 ) { names.insert( k ); made = true; }
+    else ok = errno == EEXIST;		// existed before the extraction
+    }
+  const int saved_errno = errno;
+  xunlock( &mutex );
+  errno = saved_errno;
+  return ok;
+  }
+
+
+// directory 'filename' has been removed
+void Dir_registry::erase( const char * const filename )
+  { xlock( &mutex ); names.erase( dir_key( filename ) ); xunlock( &mutex ); }
+
+void Dir_registry::clear()
+  { xlock( &mutex ); names.clear(); xunlock( &mutex ); }
+
+
+/* Set the mode and times of the directories extracted, relative to 'dirfd'.
+   Subdirectories are processed before their parents, in case a parent is
+   made unsearchable. 'dir_metadata' is emptied. */
+void set_dir_metadata( std::vector< Dir_metadata > & dir_metadata,
+                       const int dirfd )
+  {
+  std::vector< Dir_metadata > & v = dir_metadata;
+  std::stable_sort( v.begin(), v.end(), larger_name );
+  for( unsigned i = 0; i < v.size(); ++i )
+    {
+    const Dir_metadata & md = v[i];
+    struct stat st;			// skip dirs replaced by other files
+    if( fstatat( dirfd, md.name.c_str(), &st, AT_SYMLINK_NOFOLLOW ) != 0 ||
+        !S_ISDIR( st.st_mode ) ) continue;
+    if( md.chmod ) fchmodat( dirfd, md.name.c_str(), md.mode, 0 );
+    struct timespec ts[2];
+    ts[0].tv_sec = md.atime; ts[0].tv_nsec = 0;
+    ts[1].tv_sec = md.mtime; ts[1].tv_nsec = 0;
+    utimensat( dirfd, md.name.c_str(), ts, 0 );	// ignore errors
+    }
+  v.clear();
+  }
+
+
 T_names::T_names( const char * const filename )
   {
   buffer = read_t_list( filename, &file_size );
@@ -370,8 +452,39 @@ T_names::T_names( const char * const filename )
   }
 
 
+bool Cl_names::Name_entry::operator<( const Name_entry & e ) const
+  {
+  const int diff =
+    std::memcmp( name, e.name, std::min( key_size, e.key_size ) );
+  if( diff != 0 ) return diff < 0;
+  if( key_size != e.key_size ) return key_size < e.key_size;
+  if( arg_idx != e.arg_idx ) return arg_idx < e.arg_idx;
+  return name_idx < e.name_idx;
+  }
+
+
+namespace {
+
+void add_name( std::vector< Cl_names::Name_entry > & name_index,
+               const char * const name, const int arg_idx,
+               const unsigned name_idx )
+  {
+  std::string removed_prefix;
+  Cl_names::Name_entry entry;
+  entry.name = remove_leading_dotslash( name, &removed_prefix );
+  entry.key_size = std::strlen( entry.name );
+  while( entry.key_size > 0 && entry.name[entry.key_size-1] == '/' )
+    --entry.key_size;
+  entry.arg_idx = arg_idx;
+  entry.name_idx = name_idx;
+  name_index.push_back( entry );
+  }
+
+} // end namespace
+
+
 Cl_names::Cl_names( const Arg_parser & parser )
-  : name_pending_or_idx( parser.arguments(), false )
+  : name_pending_or_idx( parser.arguments(), false ), first_chdir_idx( -1 )
   {
   for( int i = 0; i < parser.arguments(); ++i )
     {
@@ -382,9 +495,53 @@ Cl_names::Cl_names( const Arg_parser & parser )
             "More than 256 '-T' options in command line." ); std::exit( 1 ); }
       name_pending_or_idx[i] = t_vec.size();
       t_vec.push_back( new T_names( parser.argument( i ).c_str() ) );
+      const T_names & t_names = *t_vec.back();
+      for( unsigned j = 0; j < t_names.names(); ++j )
+        add_name( name_index, t_names.name( j ), i, j );
+      }
+    else if( nonempty_arg( parser, i ) )
+      { name_pending_or_idx[i] = true;
+        add_name( name_index, parser.argument( i ).c_str(), i, 0 ); }
+    else if( parser.code( i ) == 'C' && first_chdir_idx < 0 )
+      first_chdir_idx = i;
+    }
+  std::sort( name_index.begin(), name_index.end() );
+  }
+
+
+/* Return the first name, in command-line order, that matches filename, or
+   0 if none matches. A name matches if it is equal to filename ignoring
+   trailing slashes, or, if recursive, if it is a parent directory of
+   filename. Only the names equal to filename or to one of its parent
+   directories (ignoring trailing slashes) are tested. */
+const Cl_names::Name_entry *
+Cl_names::find_name( const char * const filename, const bool recursive ) const
+  {
+  const Name_entry * best = 0;
+  int size = std::strlen( filename );
+  while( size > 0 && filename[size-1] == '/' ) --size;
+  for( int key_size = size; key_size > 0; --key_size )
+    {
+    if( key_size < size &&
+        ( !recursive || filename[key_size] != '/' ||
+          filename[key_size-1] == '/' ) ) continue;
+    Name_entry key;
+    key.name = filename; key.key_size = key_size;
+    key.arg_idx = -1; key.name_idx = 0;
+    for( std::vector< Name_entry >::const_iterator it =
+         std::lower_bound( name_index.begin(), name_index.end(), key );
+         it != name_index.end() && it->key_size == key_size &&
+         std::memcmp( it->name, filename, key_size ) == 0; ++it )
+      {
+      if( best && ( best->arg_idx < it->arg_idx ||
+          ( best->arg_idx == it->arg_idx && best->name_idx < it->name_idx ) ) )
+        break;		// entries are sorted by position in command line
+      if( ( recursive && compare_prefix_dir( it->name, filename ) ) ||
+          compare_tslash( it->name, filename ) )
+        { best = &*it; break; }
       }
-    else if( nonempty_arg( parser, i ) ) name_pending_or_idx[i] = true;
     }
+  return best;
   }
 
 
@@ -20,6 +20,8 @@
 #include <algorithm>
 #include <cerrno>
 #include <cstdio>
+#include <map>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #if !defined __FreeBSD__ && !defined __OpenBSD__ && !defined __NetBSD__ && \
@@ -35,13 +37,18 @@
 #include "tarlz.h"
 #include <lzlib.h>		// uint8_t defined in tarlz.h
 #include "arg_parser.h"
-#include "common_mutex.h"	// for fill_headers
+#include "common_mutex.h"	// for fill_headers and catworker
 #include "create.h"
 
 #ifndef FTW_XDEV
 #define FTW_XDEV FTW_MOUNT
 #endif
 
+#if defined __linux__ && defined __GLIBC__ && \
+    ( __GLIBC__ > 2 || ( __GLIBC__ == 2 && __GLIBC_MINOR__ >= 27 ) )
+#define HAVE_COPY_FILE_RANGE
+#endif
+
 Archive_attrs archive_attrs;	// archive attributes at time of creation
 
 
@@ -55,6 +62,131 @@ Resizable_buffer grbuf;				// extended header + data
 int goutfd = -1;
 
 
+/* Find hard links and, if --dedup, files with identical contents, so that
+   they can be archived as links to the first name stored in the archive.
+   Used only by the thread reading the file tree, which needs no locking.
+   Files are hashed only if another file of the same size has been seen.
+   Equal CRCs are confirmed by comparing the contents of both files. */
+class Link_cache
+  {
+  struct Inode
+    {
+    dev_t dev;
+    ino_t ino;
+    explicit Inode( const struct stat & st )
+      : dev( st.st_dev ), ino( st.st_ino ) {}
+    bool operator<( const Inode & i ) const
+      { return dev < i.dev || ( dev == i.dev && ino < i.ino ); }
+    };
+
+  struct Copy				// file that may have duplicates
+    {
+    std::string filename;		// name used to open the file
+    std::string stored_name;		// name stored in the archive
+    mode_t mode;
+    uid_t uid;
+    gid_t gid;
+    uint32_t crc;
+    bool crc_valid;
+    };
+
+  enum { buffer_size = 65536 };
+  std::map< Inode, std::string > inodes;	// first name of each inode
+  std::map< long long, std::vector< Copy > > copies;	// indexed by size
+  uint8_t buf1[buffer_size];
+  uint8_t buf2[buffer_size];
+
+  bool file_crc( const char * const filename, const long long size,
+                 uint32_t & crc )
+    {
+    const int fd = open( filename, O_RDONLY );
+    if( fd < 0 ) return false;
+    long long rest = size;
+    crc = 0xFFFFFFFFU;
+    while( true )
+      {
+      const int rd = readblock( fd, buf1, buffer_size );
+      if( rd > rest ) break;
+      crc32c.update_buf( crc, buf1, rd ); rest -= rd;
+      if( rd < buffer_size ) break;
+      }
+    close( fd );
+    crc ^= 0xFFFFFFFFU;
+    return rest == 0;
+    }
+
+  bool same_contents( const char * const name1, const char * const name2 )
+    {
+    const int fd1 = open( name1, O_RDONLY );
+    if( fd1 < 0 ) return false;
+    const int fd2 = open( name2, O_RDONLY );
+    if( fd2 < 0 ) { close( fd1 ); return false; }
+    bool same;
+    while( true )
+      {
+      const int rd = readblock( fd1, buf1, buffer_size );
+      same = readblock( fd2, buf2, buffer_size ) == rd &&
+             std::memcmp( buf1, buf2, rd ) == 0;
+      if( !same || rd < buffer_size ) break;
+      }
+    close( fd2 ); close( fd1 );
+    return same;
+    }
+
+public:
+  /* Return the stored name of a previous file that is a hard link to, or
+     a copy of, filename, or 0 if none is found. */
+  const std::string * find_link( const char * const filename,
+                                 const struct stat & st, const bool dedup )
+    {
+    std::string removed_prefix;
+    const char * const stored_name =
+      remove_leading_dotslash( filename, &removed_prefix, true );
+    const bool linked = st.st_nlink > 1;
+    if( linked )
+      {
+      std::map< Inode, std::string >::const_iterator it =
+        inodes.find( Inode( st ) );
+      if( it != inodes.end() ) return &it->second;
+      }
+    const std::string * target = 0;
+    if( dedup && st.st_size > 0 )
+      {
+      std::vector< Copy > & v = copies[st.st_size];
+      uint32_t crc = 0;
+      bool crc_valid = false;
+      for( unsigned i = 0; i < v.size(); ++i )
+        {
+        Copy & c = v[i];
+        if( c.mode != st.st_mode || c.uid != st.st_uid || c.gid != st.st_gid )
+          continue;
+        if( !crc_valid && !( crc_valid =
+            file_crc( filename, st.st_size, crc ) ) ) break;
+        if( !c.crc_valid && !( c.crc_valid =
+            file_crc( c.filename.c_str(), st.st_size, c.crc ) ) ) continue;
+        if( c.crc == crc && same_contents( c.filename.c_str(), filename ) )
+          { target = &c.stored_name; break; }
+        }
+      if( !target )
+        {
+        Copy c;
+        c.filename = filename; c.stored_name = stored_name;
+        c.mode = st.st_mode; c.uid = st.st_uid; c.gid = st.st_gid;
+        c.crc = crc; c.crc_valid = crc_valid;
+        v.push_back( c );
+        }
+      }
+    if( linked ) inodes[Inode( st )] = target ? *target : stored_name;
+    return target;
+    }
+
+  // Names of copies are relative to the current directory.
+  void cwd_changed() { copies.clear(); }
+  };
+
+Link_cache link_cache;
+
+
 bool option_C_after_relative_filename_or_T( const Arg_parser & parser )
   {
   for( int i = 0; i < parser.arguments(); ++i )
@@ -354,6 +486,266 @@ bool check_tty_out( const char * const archive_namep, const int outfd,
   return true;
   }
 
+
+#ifdef HAVE_COPY_FILE_RANGE
+/* Copy data from infd to outfd inside the kernel (or by reflink in CoW file
+   systems) advancing the file offsets of both. Return the number of bytes
+   copied. Stop at the first error and leave the rest to copy_file.
+   If infd and outfd refer to the same file, copy in chunks not larger than
+   the distance between source and destination so that they don't overlap.
+   Chunks smaller than 64 KiB are faster copied by copy_file.
+*/
+long long kernel_copy( const int infd, const int outfd,
+                       const long long max_size )
+  {
+  long long chunk_size = 1LL << 30;
+  struct stat ist, ost;
+  if( fstat( infd, &ist ) != 0 || fstat( outfd, &ost ) != 0 ||
+      !S_ISREG( ist.st_mode ) || !S_ISREG( ost.st_mode ) ) return 0;
+  if( ist.st_dev == ost.st_dev && ist.st_ino == ost.st_ino )
+    {
+    const long long ipos = lseek( infd, 0, SEEK_CUR );
+    const long long opos = lseek( outfd, 0, SEEK_CUR );
+    if( ipos < 0 || opos < 0 || ipos - opos < 65536 ) return 0;
+    chunk_size = std::min( chunk_size, ipos - opos );
+    }
+  long long copied_size = 0;
+  while( max_size < 0 || copied_size < max_size )
+    {
+    const long long size = ( max_size < 0 ) ? chunk_size :
+                           std::min( chunk_size, max_size - copied_size );
+    const ssize_t n = copy_file_range( infd, 0, outfd, 0, size, 0 );
+    if( n > 0 ) copied_size += n;
+    else if( n == 0 || errno != EINTR ) break;	// EOF or error
+    }
+  return copied_size;
+  }
+#endif
+
+
+/* Copy 'size' bytes from the beginning of infd to position 'opos' of outfd
+   using positional I/O so that several archives can be copied in parallel.
+   Set errcode to errno, or to -1 if EOF is found before 'size' bytes. */
+bool copy_range( const int infd, const int outfd, const long long size,
+                 const long long opos, int & errcode )
+  {
+  off_t ipos = 0, pos = opos;
+#ifdef HAVE_COPY_FILE_RANGE
+  while( ipos < size )
+    {
+    const long long rest = std::min( size - ipos, 1LL << 30 );
+    const ssize_t n = copy_file_range( infd, &ipos, outfd, &pos, rest, 0 );
+    if( n <= 0 && ( n == 0 || errno != EINTR ) ) break;	// EOF or error
+    }
+#endif
+  const int buffer_size = 65536;
+  uint8_t * const buffer = ( ipos < size ) ? new uint8_t[buffer_size] : 0;
+  errcode = 0;
+  while( ipos < size )
+    {
+    const int rsize = std::min( (long long)buffer_size, size - ipos );
+    int sz = 0;
+    while( sz < rsize )
+      {
+      const int n = pread( infd, buffer + sz, rsize - sz, ipos + sz );
+      if( n > 0 ) sz += n;
+      else if( n == 0 ) { errcode = -1; break; }		// EOF
+      else if( errno != EINTR ) { errcode = errno; break; }
+      }
+    for( int wsz = 0; errcode == 0 && wsz < sz; )
+      {
+      const int n = pwrite( outfd, buffer + wsz, sz - wsz, pos + wsz );
+      if( n > 0 ) wsz += n;
+      else if( n < 0 && errno != EINTR ) errcode = errno;
+      }
+    if( errcode ) break;
+    ipos += sz; pos += sz;
+    }
+  if( buffer ) delete[] buffer;
+  return ipos == size;
+  }
+
+
+struct Cat_input			// archive to be concatenated
+  {
+  const char * filename;
+  long long lz_size;		// returned by check_compressed_appendable
+  long long un_size;		// returned by check_uncompressed_appendable
+  long long size;		// size to be copied, -1 if skipped
+  long long pos;		// position in the output archive
+  int open_errno;		// errno if open failed, -1 if directory
+  int copy_errno;
+  bool is_the_archive;
+  bool copied;
+
+  explicit Cat_input( const char * const name )
+    : filename( name ), lz_size( -1 ), un_size( -1 ), size( -1 ), pos( 0 ),
+      open_errno( 0 ), copy_errno( 0 ), is_the_archive( false ),
+      copied( false ) {}
+  };
+
+
+struct Cat_arg
+  {
+  std::vector< Cat_input > * inputs;
+  unsigned long * next;			// next input to be processed
+  unsigned long end;			// number of inputs to be processed
+  pthread_mutex_t * mutex;
+  int outfd;				// -1 = check inputs, else copy them
+  };
+
+
+/* Check the inputs for appendability, or copy them to outfd at the
+   positions calculated from the sizes found by the check. Each input is
+   opened and closed by the worker so that the number of inputs is not
+   limited by the maximum number of open files.
+*/
+extern "C" void * catworker( void * arg )
+  {
+  const Cat_arg & tmp = *(const Cat_arg *)arg;
+  std::vector< Cat_input > & inputs = *tmp.inputs;
+
+  while( true )
+    {
+    xlock( tmp.mutex );
+    const unsigned long i = (*tmp.next)++;
+    xunlock( tmp.mutex );
+    if( i >= tmp.end ) break;
+    Cat_input & in = inputs[i];
+    const int infd = open( in.filename, O_RDONLY );
+    if( infd < 0 )
+      { if( tmp.outfd < 0 ) in.open_errno = errno; else in.copy_errno = errno;
+        continue; }
+    if( tmp.outfd >= 0 )
+      { if( in.size >= 0 )
+          in.copied = copy_range( infd, tmp.outfd, in.size, in.pos,
+                                  in.copy_errno );
+        close( infd ); continue; }
+    struct stat st;
+    if( fstat( infd, &st ) == 0 )
+      {
+      if( S_ISDIR( st.st_mode ) )
+        { in.open_errno = -1; close( infd ); continue; }
+      in.is_the_archive = archive_attrs.is_the_archive( st );
+      }
+    if( !in.is_the_archive )
+      {
+      in.lz_size = check_compressed_appendable( infd, false );
+      if( in.lz_size <= 0 )
+        in.un_size = check_uncompressed_appendable( infd, false );
+      }
+    close( infd );
+    }
+  return 0;
+  }
+
+
+void run_catworkers( Cat_arg & arg, const int num_workers )
+  {
+  unsigned long next = 0;
+  pthread_mutex_t mutex;
+  xinit_mutex( &mutex );
+  arg.next = &next; arg.mutex = &mutex;
+  const int workers = std::min( (unsigned long)num_workers, arg.end );
+  std::vector< pthread_t > threads( workers );
+  for( int i = 0; i < workers; ++i )
+    {
+    const int errcode = pthread_create( &threads[i], 0, catworker, &arg );
+    if( errcode )
+      { show_error( "Can't create worker threads", errcode ); exit_fail_mt(); }
+    }
+  for( int i = workers - 1; i >= 0; --i )
+    {
+    const int errcode = pthread_join( threads[i], 0 );
+    if( errcode )
+      { show_error( "Can't join worker threads", errcode ); exit_fail_mt(); }
+    }
+  xdestroy_mutex( &mutex );
+  }
+
+
+/* Concatenate the inputs in parallel. The inputs are checked in parallel,
+   then their positions in the output are calculated from their sizes, and
+   finally they are copied in parallel. Messages are shown in the same
+   order as if the inputs were processed sequentially.
+*/
+int concatenate_mt( const Cl_options & cl_opts, const int outfd,
+                    int & compressed, bool & eoa_pending )
+  {
+  std::vector< Cat_input > inputs;
+  for( int i = 0; i < cl_opts.parser.arguments(); ++i )
+    {
+    if( !nonempty_arg( cl_opts.parser, i ) ) continue;	// skip opts, empty names
+    const char * const filename = cl_opts.parser.argument( i ).c_str();
+    if( !Exclude::excluded( filename ) )		// skip excluded files
+      inputs.push_back( Cat_input( filename ) );
+    }
+  const long long opos = lseek( outfd, 0, SEEK_CUR );
+  if( opos < 0 )
+    { show_file_error( archive_namep, seek_msg, errno ); return 1; }
+  Cat_arg arg;
+  arg.inputs = &inputs; arg.end = inputs.size(); arg.outfd = -1;
+  run_catworkers( arg, cl_opts.num_workers );
+
+  int retval = 0;
+  long long pos = opos;
+  unsigned long end = 0;			// first input not copied
+  for( ; end < inputs.size(); ++end )		// calculate positions
+    {
+    Cat_input & in = inputs[end];
+    if( in.open_errno ) { retval = 1; break; }
+    if( in.is_the_archive ) continue;
+    long long size;
+    if( compressed < 0 )		// not initialized yet
+      {
+      if( ( size = in.lz_size ) > 0 ) compressed = true;
+      else if( ( size = in.un_size ) > 0 ) compressed = false;
+      else if( size != -2 )
+        { size = -1; compressed = has_lz_ext( in.filename ); }
+      }
+    else size = compressed ? in.lz_size : in.un_size;
+    if( size == -2 ) { retval = 1; break; }
+    if( size < 0 ) { retval = 2; break; }
+    in.size = size; in.pos = pos; pos += size;
+    }
+  if( end > 0 )					// copy inputs
+    { arg.end = end; arg.outfd = outfd;
+      run_catworkers( arg, cl_opts.num_workers ); }
+
+  pos = opos;
+  for( unsigned long i = 0; i < end; ++i )	// report results in order
+    {
+    const Cat_input & in = inputs[i];
+    if( in.is_the_archive )
+      { show_file_error( in.filename, "Archive can't contain itself; "
+                         "not concatenated." ); continue; }
+    if( !in.copied )
+      { show_file_error( in.filename, "Error concatenating archive",
+                         ( in.copy_errno > 0 ) ? in.copy_errno : 0 );
+        if( ftruncate( outfd, in.pos ) != 0 ) {}	// remove later inputs
+        eoa_pending = false; return 1; }
+    pos = in.pos + in.size;
+    eoa_pending = true;
+    if( verbosity >= 1 ) std::fprintf( stderr, "%s\n", in.filename );
+    }
+  if( end < inputs.size() )			// report error in check
+    {
+    const Cat_input & in = inputs[end];
+    if( in.open_errno > 0 )
+      show_file_error( in.filename, rd_open_msg, in.open_errno );
+    else if( in.open_errno < 0 )
+      show_file_error( in.filename, "Can't read. Is a directory." );
+    else if( retval == 1 ) show_error( mem_msg );
+    else show_file_error( in.filename, compressed ?
+                          "Not an appendable tar.lz archive." :
+                          "Not an appendable tar archive." );
+    }
+  if( lseek( outfd, pos, SEEK_SET ) != pos )
+    { show_file_error( archive_namep, seek_msg, errno ); eoa_pending = false;
+      if( retval == 0 ) retval = 1; }
+  return retval;
+  }
+
 } // end namespace
 
 
@@ -364,9 +756,13 @@ bool copy_file( const int infd, const int outfd, const char * const filename,
                 const long long max_size )
   {
   const long long buffer_size = 65536;
-  // remaining number of bytes to copy
-  long long rest = (max_size >= 0) ? max_size : buffer_size;
   long long copied_size = 0;
+#ifdef HAVE_COPY_FILE_RANGE
+  copied_size = kernel_copy( infd, outfd, max_size );
+  if( max_size >= 0 && copied_size >= max_size ) return true;
+#endif
+  // remaining number of bytes to copy
+  long long rest = (max_size >= 0) ? max_size - copied_size : buffer_size;
   uint8_t * const buffer = new uint8_t[buffer_size];
   bool error = false;
 
@@ -470,7 +866,20 @@ bool fill_headers( std::string & estr, const char * const filename,
   else { extended.set_atime( gcl_opts->mtime_set ? mtime : st.st_atime );
          extended.set_mtime( mtime ); force_extended_name = true; }
   Typeflag typeflag;
-  if( S_ISREG( mode ) ) typeflag = tf_regular;
+  if( S_ISREG( mode ) )
+    {
+    typeflag = tf_regular;
+    const std::string * const target = !gcl_opts->hard_links ? 0 :
+      link_cache.find_link( filename, st, gcl_opts->dedup );
+    if( target )
+      {
+      typeflag = tf_link;
+      const unsigned len = target->size();
+      if( len <= linkname_l )
+        std::memcpy( header + linkname_o, target->data(), len );
+      else { extended.linkpath( target->c_str() ); force_extended_name = true; }
+      }
+    }
   else if( S_ISDIR( mode ) )
     {
     typeflag = tf_directory;
@@ -648,7 +1057,9 @@ int concatenate( const Cl_options & cl_opts )
 
   int retval = 0;
   bool eoa_pending = false;
-  for( int i = 0; i < cl_opts.parser.arguments(); ++i )	// copy archives
+  if( !to_stdout && cl_opts.num_workers > 1 )	// copy archives in parallel
+    retval = concatenate_mt( cl_opts, outfd, compressed, eoa_pending );
+  else for( int i = 0; i < cl_opts.parser.arguments(); ++i )	// copy archives
     {
     if( !nonempty_arg( cl_opts.parser, i ) ) continue;	// skip opts, empty names
     const char * const filename = cl_opts.parser.argument( i ).c_str();
@@ -702,7 +1113,7 @@ int parse_cl_arg( const Cl_options & cl_opts, const int i,
   const std::string & arg = cl_opts.parser.argument( i );
   const char * filename = arg.c_str();	// filename from command line
   if( code == 'C' )
-    { if( chdir( filename ) == 0 ) return 0;
+    { if( chdir( filename ) == 0 ) { link_cache.cwd_changed(); return 0; }
       show_file_error( filename, chdir_msg, errno ); return 1; }
   if( code == 'T' || ( code == 0 && !arg.empty() ) )
     {
@@ -733,6 +1144,13 @@ int encode( const Cl_options & cl_opts )
   gcl_opts = &cl_opts;
 
   const bool append = cl_opts.program_mode == m_append;
+  if( cl_opts.catalog_name.size() &&
+      ( append || compressed == 0 || cl_opts.solidity == asolid ||
+        cl_opts.solidity == solid || cl_opts.num_workers <= 0 ||
+        ( cl_opts.option_C_present &&
+          option_C_after_relative_filename_or_T( cl_opts.parser ) ) ) )
+    { show_error( "Option '--catalog' requires a multithreaded '--create' "
+                  "of a multimember compressed archive.", 0, true ); return 1; }
   if( cl_opts.num_files == 0 && !cl_opts.option_T_present )
     {
     if( !append && !to_stdout )			// create archive
@@ -778,8 +1196,8 @@ int encode( const Cl_options & cl_opts )
     {
     /* CWD is not per-thread; multithreaded --create can't be used if an
        option -C appears in the command line after a relative filename or
-       after an option -T. */
-    if( cl_opts.parallel && cl_opts.num_workers > 1 &&
+       after an option -T. Hard links must be found in archive order. */
+    if( cl_opts.parallel && cl_opts.num_workers > 1 && !cl_opts.hard_links &&
         ( !cl_opts.option_C_present ||
           !option_C_after_relative_filename_or_T( cl_opts.parser ) ) )
       {
@@ -794,7 +1212,12 @@ int encode( const Cl_options & cl_opts )
         !option_C_after_relative_filename_or_T( cl_opts.parser ) ) )
       {
       // show_file_error( archive_namep, "Multithreaded --create" );
-      return encode_lz( cl_opts, archive_namep, goutfd );
+      // open catalog before changing working directory
+      int catalog_fd = -1;
+      if( cl_opts.catalog_name.size() &&
+          ( catalog_fd = open_outstream( cl_opts.catalog_name ) ) < 0 )
+        { close( goutfd ); return 1; }
+      return encode_lz( cl_opts, archive_namep, goutfd, catalog_fd );
       }
     encoder = LZ_compress_open( option_mapping[cl_opts.level].dictionary_size,
                 option_mapping[cl_opts.level].match_len_limit, LLONG_MAX );
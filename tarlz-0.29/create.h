@@ -89,7 +89,7 @@ int parse_cl_arg( const Cl_options & cl_opts, const int i,
 
 // defined in create_lz.cc
 int encode_lz( const Cl_options & cl_opts, const char * const archive_namep,
-               const int outfd );
+               const int outfd, const int catalog_fd );
 
 // defined in create_un.cc
 int encode_un( const Cl_options & cl_opts, const char * const archive_namep,
@@ -30,6 +30,7 @@
 #include "arg_parser.h"
 #include "common_mutex.h"
 #include "create.h"
+#include "catalog.h"
 
 
 namespace {
@@ -58,9 +59,12 @@ struct Opacket		// compressed data to be written to the archive
   {
   const uint8_t * data;		// data == 0 means end of lzip member
   int size;			// number of bytes in data (if any)
+  std::vector< Catalog_entry > * entries;	// tar members in lzip member
 
-  Opacket() : data( 0 ), size( 0 ) {}
-  Opacket( uint8_t * const d, const int s ) : data( d ), size( s ) {}
+  explicit Opacket( std::vector< Catalog_entry > * const e = 0 )
+    : data( 0 ), size( 0 ), entries( e ) {}
+  Opacket( uint8_t * const d, const int s )
+    : data( d ), size( s ), entries( 0 ) {}
   };
 
 
@@ -169,7 +173,7 @@ public:
     }
 
   /* Deliver opackets to muxer.
-     If opacket.data == 0, skip opacket and move to next queue. */
+     If opacket.data == 0 (end of lzip member), move to next queue. */
   void deliver_packets( std::vector< Opacket > & opacket_vector )
     {
     opacket_vector.clear();
@@ -184,8 +188,8 @@ public:
         opacket_queues[deliver_id].pop();
         if( opacket_queues[deliver_id].size() + 1 == out_slots )
           xsignal( &slot_av[deliver_id] );
-        if( opacket.data ) opacket_vector.push_back( opacket );
-        else if( ++deliver_id >= num_workers ) deliver_id = 0;
+        opacket_vector.push_back( opacket );
+        if( !opacket.data && ++deliver_id >= num_workers ) deliver_id = 0;
         }
       }
     while( opacket_vector.empty() && num_working > 0 );
@@ -358,6 +362,8 @@ extern "C" void * cworker( void * arg )
 
   int opos = 0;
   bool flushed = true;		// avoid producing empty lzip members
+  const bool catalog = gcl_opts->catalog_name.size();
+  std::vector< Catalog_entry > * entries = 0;	// tar members in lzip member
   while( true )
     {
     const Ipacket * const ipacket = courier.distribute_packet( worker_id );
@@ -366,8 +372,9 @@ extern "C" void * cworker( void * arg )
       {
       if( !flushed )			// this lzip member is not empty
         loop_encode( 0, 0, data, opos, courier, encoder, worker_id, true );
-      courier.collect_packet( Opacket(), worker_id );	// end of member token
-      flushed = true; delete ipacket; continue;
+      // end of member token
+      courier.collect_packet( Opacket( entries ), worker_id );
+      flushed = true; entries = 0; delete ipacket; continue;
       }
 
     const char * const filename = ipacket->filename.c_str();
@@ -394,6 +401,19 @@ extern "C" void * cworker( void * arg )
     const int ebsize = ipacket->extended->format_block( rbuf );	// may be 0
     if( ebsize < 0 )
       { show_error( ipacket->extended->full_size_error() ); exit_fail_mt(); }
+    if( catalog )
+      {
+      if( !entries ) entries = new( std::nothrow ) std::vector< Catalog_entry >;
+      if( !entries ) { show_error( mem_msg2 ); exit_fail_mt(); }
+      Extended extended( *ipacket->extended );	// get path from header
+      extended.fill_from_ustar( ipacket->header );
+      Catalog_entry entry;
+      entry.name = extended.path();
+      entry.member = 0;				// set by muxer
+      entry.file_size = ipacket->file_size;
+      entry.typeflag = ipacket->header[typeflag_o];
+      entries->push_back( entry );
+      }
     if( ebsize > 0 )				// compress extended block
       loop_encode( rbuf.u8(), ebsize, data, opos, courier, encoder, worker_id );
     // compress ustar header
@@ -432,6 +452,7 @@ extern "C" void * cworker( void * arg )
         set_error_status( 1 ); }
     delete ipacket;
     }
+  if( entries ) delete entries;
   if( data ) delete[] data;
   if( encoder && LZ_compress_close( encoder ) < 0 )
     { show_error( "LZ_compress_close failed." ); exit_fail_mt(); }
@@ -441,10 +462,14 @@ extern "C" void * cworker( void * arg )
 
 /* Get from courier the processed and sorted packets, and write
    their contents to the output archive.
+   Collect the catalog entries and the sizes of the lzip members written.
 */
-void muxer( Packet_courier & courier, const int outfd )
+void muxer( Packet_courier & courier, const int outfd,
+            std::vector< Catalog_entry > & catalog,
+            std::vector< long long > & member_sizes )
   {
   std::vector< Opacket > opacket_vector;
+  long long member_size = 0;
   while( true )
     {
     courier.deliver_packets( opacket_vector );
@@ -453,9 +478,23 @@ void muxer( Packet_courier & courier, const int outfd )
     for( unsigned i = 0; i < opacket_vector.size(); ++i )
       {
       Opacket & opacket = opacket_vector[i];
-      if( !writeblock_wrapper( outfd, opacket.data, opacket.size ) )
-        exit_fail_mt();
-      delete[] opacket.data;
+      if( opacket.data )
+        {
+        if( !writeblock_wrapper( outfd, opacket.data, opacket.size ) )
+          exit_fail_mt();
+        delete[] opacket.data; member_size += opacket.size; continue;
+        }
+      if( opacket.entries )			// end of lzip member
+        {
+        for( unsigned j = 0; j < opacket.entries->size(); ++j )
+          {
+          catalog.push_back( (*opacket.entries)[j] );
+          catalog.back().member = member_sizes.size();
+          }
+        delete opacket.entries;
+        }
+      if( member_size > 0 )
+        { member_sizes.push_back( member_size ); member_size = 0; }
       }
     }
   }
@@ -465,7 +504,7 @@ void muxer( Packet_courier & courier, const int outfd )
 
 // init the courier, then start the grouper and the workers and call the muxer
 int encode_lz( const Cl_options & cl_opts, const char * const archive_namep,
-               const int outfd )
+               const int outfd, const int catalog_fd )
   {
   const int in_slots = 65536;		// max small files (<=512B) in 64 MiB
   const int num_workers = cl_opts.num_workers;
@@ -504,7 +543,9 @@ int encode_lz( const Cl_options & cl_opts, const char * const archive_namep,
       { show_error( "Can't create worker threads", errcode ); exit_fail_mt(); }
     }
 
-  muxer( courier, outfd );
+  std::vector< Catalog_entry > catalog;
+  std::vector< long long > member_sizes;
+  muxer( courier, outfd, catalog, member_sizes );
 
   for( int i = num_workers - 1; i >= 0; --i )
     {
@@ -524,6 +565,12 @@ int encode_lz( const Cl_options & cl_opts, const char * const archive_namep,
 
   if( close( outfd ) != 0 && retval == 0 )
     { show_file_error( archive_namep, eclosa_msg, errno ); retval = 1; }
+  if( catalog_fd >= 0 )
+    {
+    if( retval != 0 ) close( catalog_fd );
+    else if( !write_catalog( cl_opts.catalog_name, catalog_fd, catalog,
+                             member_sizes ) ) retval = 1;
+    }
 
   if( cl_opts.debug_level & 1 )
     std::fprintf( stderr,
@@ -88,8 +88,8 @@ int compare_member( const Cl_options & cl_opts, Archive_reader & ar,
   if( ostr.size() ) { std::fputs( ostr.c_str(), stdout ); std::fflush( stdout ); }
   if( extended.file_size() <= 0 ) return 0;
   const Typeflag typeflag = (Typeflag)header[typeflag_o];
-  if( ( typeflag != tf_regular && typeflag != tf_hiperf ) || stat_differs )
-    return skip_member( ar, extended, typeflag );
+  if( ( typeflag != tf_regular && typeflag != tf_hiperf ) || stat_differs ||
+      cl_opts.ignore_contents ) return skip_member( ar, extended, typeflag );
   // else compare file contents
   const char * const filename = extended.path().c_str();
   const int infd2 = open_instream( filename );
@@ -114,7 +114,9 @@ int list_member( Archive_reader & ar,
 
 
 int extract_member( const Cl_options & cl_opts, Archive_reader & ar,
-                    const Extended & extended, const Tar_header header )
+                    const Extended & extended, const Tar_header header,
+                    Dir_registry & dir_registry,
+                    std::vector< Dir_metadata > & dir_metadata )
   {
   const char * const filename = extended.path().c_str();
   const Typeflag typeflag = (Typeflag)header[typeflag_o];
@@ -126,16 +128,17 @@ int extract_member( const Cl_options & cl_opts, Archive_reader & ar,
   mode_t mode = parse_octal( header + mode_o, mode_l );	 // 12 bits
   if( geteuid() != 0 && !cl_opts.preserve_permissions ) mode &= ~get_umask();
   int outfd = -1;
+  bool dir_made = false;		// dir created by this run
 
   if( !show_member_name( extended, header, 1, grbuf ) ) return 1;
-  if( !make_dirs( filename ) )
+  if( !dir_registry.make_dirs( extended.path() ) )
     {
     show_file_error( filename, intdir_msg, errno );
     set_error_status( 1 );
     return skip_member( ar, extended, typeflag );
     }
   // remove file or empty dir before extraction to prevent following links
-  std::remove( filename );
+  if( std::remove( filename ) == 0 ) dir_registry.erase( filename );
 
   switch( typeflag )
     {
@@ -158,7 +161,9 @@ int extract_member( const Cl_options & cl_opts, Archive_reader & ar,
         }
       } break;
     case tf_directory:
-      if( mkdir( filename, mode ) != 0 && errno != EEXIST )
+      // create dir writable by the owner; set its mode at the end
+      if( !dir_registry.make_dir( AT_FDCWD, filename, filename, mode | S_IRWXU,
+                                  dir_made ) )
         {
         show_file_error( filename, mkdir_msg, errno );
         set_error_status( 1 );
@@ -236,7 +241,14 @@ int extract_member( const Cl_options & cl_opts, Archive_reader & ar,
     }
   if( outfd >= 0 && close( outfd ) != 0 )
     { show_file_error( filename, eclosf_msg, errno ); return 1; }
-  if( !islink )
+  if( typeflag == tf_directory )		// defer until all files extracted
+    {
+    Dir_metadata md;
+    md.name = extended.path(); md.atime = extended.atime().sec();
+    md.mtime = extended.mtime().sec(); md.mode = mode; md.chmod = dir_made;
+    dir_metadata.push_back( md );
+    }
+  else if( !islink )
     {
     struct utimbuf t;
     t.actime = extended.atime().sec();
@@ -247,6 +259,20 @@ int extract_member( const Cl_options & cl_opts, Archive_reader & ar,
   }
 
 
+/* An option -C may have changed the working directory. If so, set the
+   metadata of the directories extracted into the previous one ('dirfd'). */
+void check_cwd( int & dirfd, Dir_registry & dir_registry,
+                std::vector< Dir_metadata > & dir_metadata )
+  {
+  struct stat st1, st2;
+  if( dirfd >= 0 && fstat( dirfd, &st1 ) == 0 && stat( ".", &st2 ) == 0 &&
+      st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino ) return;
+  if( dirfd >= 0 ) { set_dir_metadata( dir_metadata, dirfd ); close( dirfd ); }
+  dir_registry.clear();
+  dirfd = open( ".", O_RDONLY | O_DIRECTORY );
+  }
+
+
 void format_file_diff( std::string & ostr, const char * const filename,
                        const char * const msg )
   { if( verbosity >= 0 )
@@ -356,6 +382,10 @@ bool compare_file_type( std::string & estr, std::string & ostr,
   }
 
 
+/* Compare the data of the current tar member with the contents of infd2
+   in blocks of up to 1 MiB. The kernel is asked to read ahead the next
+   block of infd2 while the current block is being decompressed.
+*/
 bool compare_file_contents( std::string & estr, std::string & ostr,
                             Archive_reader_base & ar, const long long file_size,
                             const char * const filename, const int infd2 )
@@ -363,9 +393,23 @@ bool compare_file_contents( std::string & estr, std::string & ostr,
   long long rest = file_size;
   const int rem = rest % header_size;
   const int padding = rem ? header_size - rem : 0;
-  const int bufsize = 32 * header_size;
-  uint8_t buf1[bufsize];
-  uint8_t buf2[bufsize];
+  enum { min_bufsize = 32 * header_size, max_bufsize = 1 << 20 };
+  uint8_t sbuf[2*min_bufsize];
+  uint8_t * heap_buf = 0;
+  int bufsize = min_bufsize;
+  if( rest + padding > min_bufsize )
+    {
+    const int size = std::min( rest + padding, (long long)max_bufsize );
+    heap_buf = new( std::nothrow ) uint8_t[2*size];
+    if( heap_buf ) bufsize = size;
+    }
+  uint8_t * const buf1 = heap_buf ? heap_buf : sbuf;
+  uint8_t * const buf2 = buf1 + bufsize;
+  long long file_pos = 0;
+#ifdef POSIX_FADV_WILLNEED
+  posix_fadvise( infd2, 0, 0, POSIX_FADV_SEQUENTIAL );
+  posix_fadvise( infd2, 0, bufsize, POSIX_FADV_WILLNEED );
+#endif
   int retval = 0;
   bool dif = false;
   estr.clear(); ostr.clear();
@@ -377,22 +421,24 @@ bool compare_file_contents( std::string & estr, std::string & ostr,
     if( !dif )
       {
       const int rd = readblock( infd2, buf2, rsize2 );
+      file_pos += rd;
+#ifdef POSIX_FADV_WILLNEED
+      if( rest > rsize2 )
+        posix_fadvise( infd2, file_pos, bufsize, POSIX_FADV_WILLNEED );
+#endif
       if( rd != rsize2 )
         {
         if( errno ) format_file_error( estr, filename, rd_err_msg, errno );
         else format_file_diff( ostr, filename, "EOF found in file" );
         dif = true;
         }
-      else
-        {
-        int i = 0; while( i < rsize2 && buf1[i] == buf2[i] ) ++i;
-        if( i < rsize2 )
-          { format_file_diff( ostr, filename, "Contents differ" ); dif = true; }
-        }
+      else if( std::memcmp( buf1, buf2, rsize2 ) != 0 )
+        { format_file_diff( ostr, filename, "Contents differ" ); dif = true; }
       }
     if( rest < bufsize ) break;
     rest -= rsize1;
     }
+  if( heap_buf ) delete[] heap_buf;
   close( infd2 );
   if( dif ) set_error_status( 1 );
   return retval;
@@ -408,6 +454,11 @@ int decode( const Cl_options & cl_opts )
   if( ad.name.size() && ad.indexed && ad.lzip_index.multi_empty() )
     { show_file_error( ad.namep, empty_member_msg ); close( ad.infd ); return 2; }
 
+  // open catalog before changing working directory
+  const int catalog_fd = ( cl_opts.catalog_name.size() &&
+    ( cl_opts.num_files > 0 || cl_opts.option_T_present ) ) ?
+    open_instream( cl_opts.catalog_name.c_str() ) : -1;
+
   const Arg_parser & parser = cl_opts.parser;
   const bool c_present = cl_opts.option_C_present &&
                          cl_opts.program_mode != m_list;
@@ -434,10 +485,20 @@ int decode( const Cl_options & cl_opts )
      but multithreaded --diff and --extract probably need at least 2 of each. */
   if( cl_opts.num_workers > 0 && !c_after_name && ad.indexed &&
       ad.lzip_index.members() >= 2 )	// 2 lzip members may be 1 file + EOA
-    return decode_lz( cl_opts, ad, cl_names );
+    return decode_lz( cl_opts, ad, cl_names, catalog_fd );
+  if( catalog_fd >= 0 ) close( catalog_fd );	// catalog needs parallel decode
+  /* An uncompressed seekable archive is decoded in parallel if its headers
+     can be scanned up to the EOA blocks without errors. */
+  std::vector< Block > tar_blocks;
+  if( cl_opts.num_workers > 0 && !c_after_name &&
+      index_tar( cl_opts, ad, tar_blocks ) )
+    return decode_lz( cl_opts, ad, cl_names, -1, &tar_blocks );
 
   Archive_reader ar( ad );		// serial reader
   Extended extended;			// metadata from extended records
+  Dir_registry dir_registry;
+  std::vector< Dir_metadata > dir_metadata;
+  int dir_cwd_fd = -1;		// cwd of dir_metadata if c_after_name
   int retval = 0;
   bool prev_extended = false;		// prev header was extended
   while( true )				// process one tar header per iteration
@@ -502,7 +563,13 @@ int decode( const Cl_options & cl_opts )
           retval = skip_member( ar, extended, typeflag );
         else if( cl_opts.program_mode == m_diff )
           retval = compare_member( cl_opts, ar, extended, header );
-        else retval = extract_member( cl_opts, ar, extended, header );
+        else
+          {
+          if( c_after_name )
+            check_cwd( dir_cwd_fd, dir_registry, dir_metadata );
+          retval = extract_member( cl_opts, ar, extended, header, dir_registry,
+                                   dir_metadata );
+          }
         }
       }
     catch( Chdir_error & ) { retval = 1; }
@@ -513,6 +580,8 @@ int decode( const Cl_options & cl_opts )
 
   if( close( ad.infd ) != 0 && retval == 0 )
     { show_file_error( ad.namep, eclosa_msg, errno ); retval = 1; }
+  set_dir_metadata( dir_metadata, ( dir_cwd_fd >= 0 ) ? dir_cwd_fd : AT_FDCWD );
+  if( dir_cwd_fd >= 0 ) close( dir_cwd_fd );
   if( cwd_fd >= 0 ) close( cwd_fd );
 
   if( retval == 0 && cl_names.names_remain( parser ) ) set_error_status( 1 );
@@ -16,6 +16,8 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <set>
+#include <pthread.h>
 #include <sys/types.h>		// uid_t, gid_t, (BSD major, minor, makedev)
 
 inline bool data_may_follow( const Typeflag typeflag )
@@ -62,19 +64,73 @@ public:
    update and provide space for 256 '-T' options. */
 struct Cl_names
   {
+  struct Name_entry		// a name in the command line or in a -T list
+    {
+    const char * name;		// name without leading dotslash
+    int key_size;		// size of name without trailing slashes
+    int arg_idx;		// parser index of name or of its -T option
+    unsigned name_idx;		// index of name in the -T list
+    bool operator<( const Name_entry & e ) const;
+    };
+
   // if parser.code( i ) == 'T', name_pending_or_idx[i] is the index in t_vec
   std::vector< uint8_t > name_pending_or_idx;
   std::vector< T_names * > t_vec;
+  // all names sorted by key and then by position in command line
+  std::vector< Name_entry > name_index;
+  int first_chdir_idx;		// parser index of first -C, or -1 if none
 
   explicit Cl_names( const Arg_parser & parser );
   ~Cl_names() { for( unsigned i = 0; i < t_vec.size(); ++i ) delete t_vec[i]; }
 
   T_names & t_names( const unsigned i )
     { return *t_vec[name_pending_or_idx[i]]; }
+  const Name_entry * find_name( const char * const filename,
+                                const bool recursive ) const;
   bool names_remain( const Arg_parser & parser ) const;
   };
 
 
+/* Directories created by this run, by any worker. The archived mode is
+   applied to every directory member created or re-created by this run,
+   but not to directories that existed before the extraction began, no
+   matter which worker created a directory first. Directories are created
+   with the mutex locked so that a directory created by another worker is
+   never taken for a pre-existing one. */
+class Dir_registry
+  {
+  std::set< std::string > names;
+  std::vector< std::string > created;	// buffer for make_dirs
+  pthread_mutex_t mutex;
+
+  Dir_registry( const Dir_registry & );		// declared as private
+  void operator=( const Dir_registry & );	// declared as private
+
+public:
+  Dir_registry();
+  ~Dir_registry();
+
+  bool make_dirs( const std::string & filename );
+  bool make_dir( const int dirfd, const char * const name,
+                 const char * const filename, const mode_t mode, bool & made );
+  void erase( const char * const filename );
+  void clear();
+  };
+
+
+/* Metadata of the directories extracted, applied after all the files have
+   been extracted so that extracting the files inside the directories does
+   not change their mtime, and read-only directories can be filled. */
+struct Dir_metadata
+  {
+  std::string name;
+  long long atime;
+  long long mtime;
+  mode_t mode;
+  bool chmod;			// dir was created by this run; set its mode
+  };
+
+
 // defined in common_decode.cc
 bool check_skip_filename( const Cl_options & cl_opts, Cl_names & cl_names,
                           const char * const filename, const int cwd_fd = -1,
@@ -83,11 +139,17 @@ bool format_member_name( const Extended & extended, const Tar_header header,
                          Resizable_buffer & rbuf, const bool long_format );
 bool show_member_name( const Extended & extended, const Tar_header header,
                        const int vlevel, Resizable_buffer & rbuf );
+void set_dir_metadata( std::vector< Dir_metadata > & dir_metadata,
+                       const int dirfd );
 
 // defined in decode_lz.cc
 struct Archive_descriptor;			// forward declaration
+class Block;					// forward declaration
+bool index_tar( const Cl_options & cl_opts, const Archive_descriptor & ad,
+                std::vector< Block > & tar_blocks );
 int decode_lz( const Cl_options & cl_opts, const Archive_descriptor & ad,
-               Cl_names & cl_names );
+               Cl_names & cl_names, const int catalog_fd,
+               const std::vector< Block > * const tar_blocks = 0 );
 
 // defined in delete.cc
 bool safe_seek( const int fd, const long long pos );
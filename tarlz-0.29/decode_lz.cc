@@ -21,8 +21,9 @@
 #include <cerrno>
 #include <cstdio>
 #include <queue>
+#include <fcntl.h>
 #include <unistd.h>
-#include <utime.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #if !defined __FreeBSD__ && !defined __OpenBSD__ && !defined __NetBSD__ && \
     !defined __DragonFly__ && !defined __APPLE__ && !defined __OS2__
@@ -36,6 +37,11 @@
 #include "archive_reader.h"
 #include "common_mutex.h"
 #include "decode.h"
+#include "catalog.h"
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
 
 /* Parallel decode does not skip; it exits at the first error.
    When a problem is detected by any worker:
@@ -204,35 +210,188 @@ public:
   };
 
 
-// prevent two threads from extracting the same file at the same time
+/* Prevent two threads from extracting the same file at the same time.
+   Each worker reserves the name it is extracting, releasing the previous
+   one. The names are distributed by CRC among shards, each with its own
+   mutex, so that workers reserving different names rarely wait. */
 class Name_monitor
   {
-  std::vector< unsigned > crc_vector;
-  std::vector< std::string > name_vector;
-  pthread_mutex_t mutex;
+  struct Entry
+    {
+    unsigned crc;
+    int worker_id;
+    std::string name;
+    Entry( const unsigned c, const int w, const std::string & n )
+      : crc( c ), worker_id( w ), name( n ) {}
+    };
+  struct Shard
+    {
+    pthread_mutex_t mutex;
+    std::vector< Entry > entries;	// names reserved in this shard
+    };
+  std::vector< Shard > shards;
+  std::vector< int > shard_of_worker;	// shard of name reserved, or -1
+  std::vector< unsigned > wait_counters;	// per worker
+
+  Name_monitor( const Name_monitor & );		// declared as private
+  void operator=( const Name_monitor & );	// declared as private
+
+  void lock_shard( const int i, const unsigned worker_id )
+    {
+    pthread_mutex_t * const mutex = &shards[i].mutex;
+    if( pthread_mutex_trylock( mutex ) != 0 )
+      { xlock( mutex ); ++wait_counters[worker_id]; }
+    }
+
+  void remove_entry( const int i, const unsigned worker_id )
+    {
+    std::vector< Entry > & entries = shards[i].entries;
+    for( unsigned j = 0; j < entries.size(); ++j )
+      if( entries[j].worker_id == (int)worker_id )
+        { entries[j] = entries.back(); entries.pop_back(); break; }
+    }
 
 public:
-  Name_monitor( const int num_workers )
-    : crc_vector( num_workers ), name_vector( num_workers )
-    { if( num_workers > 0 ) xinit_mutex( &mutex ); }
+  explicit Name_monitor( const int num_workers )
+    : shards( 4 * num_workers ), shard_of_worker( num_workers, -1 ),
+      wait_counters( num_workers, 0 )
+    { for( unsigned i = 0; i < shards.size(); ++i )
+        xinit_mutex( &shards[i].mutex ); }
+
+  ~Name_monitor()
+    { for( unsigned i = 0; i < shards.size(); ++i )
+        xdestroy_mutex( &shards[i].mutex ); }
+
+  unsigned wait_counter() const
+    {
+    unsigned sum = 0;
+    for( unsigned i = 0; i < wait_counters.size(); ++i )
+      sum += wait_counters[i];
+    return sum;
+    }
 
   bool reserve_name( const unsigned worker_id, const std::string & filename )
     {
     // compare the CRCs of the names; compare the names if the CRCs collide
     const unsigned crc =
       crc32c.compute_crc( (const uint8_t *)filename.c_str(), filename.size() );
-    xlock( &mutex );
-    for( unsigned i = 0; i < crc_vector.size(); ++i )
-      if( crc_vector[i] == crc && crc != 0 && i != worker_id &&
-          name_vector[i] == filename )
-        { xunlock( &mutex ); return false; }	// filename already reserved
-    crc_vector[worker_id] = crc; name_vector[worker_id] = filename;
-    xunlock( &mutex );
+    const int i = crc % shards.size();
+    const int old_i = shard_of_worker[worker_id];
+    lock_shard( i, worker_id );
+    std::vector< Entry > & entries = shards[i].entries;
+    for( unsigned j = 0; j < entries.size(); ++j )
+      if( entries[j].crc == crc && entries[j].worker_id != (int)worker_id &&
+          entries[j].name == filename )
+        { xunlock( &shards[i].mutex ); return false; }	// already reserved
+    if( old_i == i ) remove_entry( i, worker_id );
+    entries.push_back( Entry( crc, worker_id, filename ) );
+    xunlock( &shards[i].mutex );
+    if( old_i >= 0 && old_i != i )		// release previous name
+      { lock_shard( old_i, worker_id ); remove_entry( old_i, worker_id );
+        xunlock( &shards[old_i].mutex ); }
+    shard_of_worker[worker_id] = i;
     return true;
     }
   };
 
 
+/* LRU cache of open file descriptors of the directories where a worker
+   extracts files. Files are created relative to these descriptors with
+   the *at functions, avoiding a lookup of the whole path for each file.
+   If no descriptor can be cached, the whole path is used. */
+class Dir_cache
+  {
+  struct Entry
+    {
+    std::string name;
+    int fd;
+    Entry( const std::string & n, const int f ) : name( n ), fd( f ) {}
+    };
+  Dir_registry & dir_registry;
+  const unsigned max_entries;
+  std::vector< Entry > entries;		// most recently used first
+
+  Dir_cache( const Dir_cache & );		// declared as private
+  void operator=( const Dir_cache & );		// declared as private
+
+  void close_lru() { close( entries.back().fd ); entries.pop_back(); }
+
+public:
+  enum { max_size = 16 };
+  Dir_cache( Dir_registry & r, const int size )
+    : dir_registry( r ), max_entries( size ) {}
+  ~Dir_cache()
+    { for( unsigned i = 0; i < entries.size(); ++i ) close( entries[i].fd ); }
+
+  /* Return fd of directory 'name', creating it if needed, AT_FDCWD if the
+     descriptor can't be cached, or -1 if error. */
+  int get( const std::string & filename, const std::string & name )
+    {
+    for( unsigned i = 0; i < entries.size(); ++i )
+      if( entries[i].name == name )
+        {
+        if( i > 0 )
+          { const Entry entry = entries[i];
+            entries.erase( entries.begin() + i );
+            entries.insert( entries.begin(), entry ); }
+        return entries[0].fd;
+        }
+    if( !dir_registry.make_dirs( filename ) ) return -1;
+    if( max_entries == 0 ) return AT_FDCWD;
+    int fd = open( name.c_str(), O_RDONLY | O_DIRECTORY );
+    if( fd < 0 && ( errno == EMFILE || errno == ENFILE ) )
+      {
+      if( entries.empty() ) return AT_FDCWD;
+      close_lru();				// evict and retry
+      fd = open( name.c_str(), O_RDONLY | O_DIRECTORY );
+      if( fd < 0 && ( errno == EMFILE || errno == ENFILE ) ) return AT_FDCWD;
+      }
+    if( fd < 0 ) return -1;
+    if( entries.size() >= max_entries ) close_lru();
+    entries.insert( entries.begin(), Entry( name, fd ) );
+    return fd;
+    }
+
+  // close the descriptors of directory 'name' and of its subdirectories
+  void invalidate( const char * const name )
+    {
+    unsigned len = std::strlen( name );
+    while( len > 1 && name[len-1] == '/' ) --len;
+    for( unsigned i = 0; i < entries.size(); )
+      {
+      const std::string & ename = entries[i].name;
+      if( ename.compare( 0, len, name, len ) == 0 &&
+          ( ename.size() == len || ename[len] == '/' ) )
+        { close( entries[i].fd ); entries.erase( entries.begin() + i ); }
+      else ++i;
+      }
+    }
+  };
+
+
+/* Hard links extracted, created after all the workers have finished
+   because the file linked may be in a lzip member decoded by other worker. */
+struct Hard_link
+  {
+  std::string linkname;
+  std::string filename;
+  long member_id;
+  long index;			// index of the Name_record of the link
+  };
+
+
+/* CRC of the name of each tar member extracted, and its position in the
+   archive. A hard link is not created if its name has been extracted
+   again by a later tar member. */
+struct Name_record
+  {
+  unsigned crc;
+  long member_id;
+  long index;			// index in the vector of the worker
+  bool operator<( const Name_record & nr ) const { return crc < nr.crc; }
+  };
+
+
 struct Trival				// triple result value
   {
   const char * msg;
@@ -280,7 +439,8 @@ Trival compare_member_lz( const Cl_options & cl_opts,
     return Trival( other_msg, 0, 1 );
   if( extended.file_size() <= 0 ) return Trival();
   const Typeflag typeflag = (Typeflag)header[typeflag_o];
-  if( ( typeflag != tf_regular && typeflag != tf_hiperf ) || stat_differs )
+  if( ( typeflag != tf_regular && typeflag != tf_hiperf ) || stat_differs ||
+      cl_opts.ignore_contents )
     return skip_member_lz( ar, courier, extended, member_id, worker_id, typeflag );
   // else compare file contents
   const char * const filename = extended.path().c_str();
@@ -323,7 +483,11 @@ Trival extract_member_lz( const Cl_options & cl_opts,
                           Archive_reader_i & ar, Packet_courier & courier,
                           const Extended & extended, const Tar_header header,
                           Resizable_buffer & rbuf, const long member_id,
-                          const int worker_id, Name_monitor & name_monitor )
+                          const int worker_id, Name_monitor & name_monitor,
+                          Dir_registry & dir_registry, Dir_cache & dir_cache,
+                          std::vector< Dir_metadata > & dir_metadata,
+                          std::vector< Hard_link > & hard_links,
+                          std::vector< Name_record > & name_records )
   {
   const char * const filename = extended.path().c_str();
   const Typeflag typeflag = (Typeflag)header[typeflag_o];
@@ -346,6 +510,7 @@ Trival extract_member_lz( const Cl_options & cl_opts,
   mode_t mode = parse_octal( header + mode_o, mode_l );	 // 12 bits
   if( geteuid() != 0 && !cl_opts.preserve_permissions ) mode &= ~get_umask();
   int outfd = -1;
+  bool dir_made = false;		// dir created by this run
 
   if( verbosity >= 1 )
     {
@@ -354,9 +519,16 @@ Trival extract_member_lz( const Cl_options & cl_opts,
     if( !courier.collect_packet( member_id, worker_id, rbuf(), Packet::ok ) )
       return Trival( other_msg, 0, 1 );
     }
-  struct stat st;
-  bool exists = lstat( filename, &st ) == 0;
-  if( !exists && !make_dirs( filename ) )
+  // split filename into the directory and the last component
+  int i = extended.path().size();
+  while( i > 0 && filename[i-1] == '/' ) --i;	// remove trailing slashes
+  while( i > 0 && filename[i-1] != '/' ) --i;	// remove last component
+  const char * name = filename + i;		// last component
+  while( i > 0 && filename[i-1] == '/' ) --i;	// remove more slashes
+  const int dirfd = ( i > 0 ) ?
+    dir_cache.get( extended.path(), std::string( filename, i ) ) : AT_FDCWD;
+  if( dirfd == AT_FDCWD ) name = filename;
+  if( dirfd == -1 )
     {
     if( format_file_error( rbuf, filename, intdir_msg, errno ) &&
         !courier.collect_packet( member_id, worker_id, rbuf(), Packet::diag ) )
@@ -364,16 +536,30 @@ Trival extract_member_lz( const Cl_options & cl_opts,
     set_error_status( 1 );
     return skip_member_lz( ar, courier, extended, member_id, worker_id, typeflag );
     }
+  struct stat st;
+  const bool exists = fstatat( dirfd, name, &st, AT_SYMLINK_NOFOLLOW ) == 0;
   /* Remove file before extraction to prevent following links.
-     Don't remove an empty dir; another thread may need it. */
-  if( exists && ( typeflag != tf_directory || !S_ISDIR( st.st_mode ) ) )
-    { exists = false; std::remove( filename ); }
+     Don't remove an empty dir; another thread may need it.
+     Hard links are created at the end, replacing the file if needed. */
+  if( exists && typeflag != tf_link &&
+      ( typeflag != tf_directory || !S_ISDIR( st.st_mode ) ) )
+    {
+    if( !S_ISDIR( st.st_mode ) ) unlinkat( dirfd, name, 0 );
+    else { dir_cache.invalidate( filename );
+           if( unlinkat( dirfd, name, AT_REMOVEDIR ) == 0 )
+             dir_registry.erase( filename ); }
+    }
+  Name_record nr;
+  nr.crc =
+    crc32c.compute_crc( (const uint8_t *)filename, extended.path().size() );
+  nr.member_id = member_id; nr.index = name_records.size();
+  name_records.push_back( nr );
 
   switch( typeflag )
     {
     case tf_regular:
     case tf_hiperf:
-      outfd = open_outstream( filename, true, &rbuf, false );
+      outfd = open_outstream_at( dirfd, name, filename, rbuf );
       if( outfd < 0 )
         {
         if( verbosity >= 0 &&
@@ -385,22 +571,28 @@ Trival extract_member_lz( const Cl_options & cl_opts,
         }
       break;
     case tf_link:
+      {
+      Hard_link hl;
+      hl.linkname = extended.linkpath(); hl.filename = extended.path();
+      hl.member_id = member_id; hl.index = nr.index;
+      hard_links.push_back( hl );
+      } break;
     case tf_symlink:
       {
       const char * const linkname = extended.linkpath().c_str();
-      const bool hard = typeflag == tf_link;
-      if( ( hard && link( linkname, filename ) != 0 ) ||
-          ( !hard && symlink( linkname, filename ) != 0 ) )
+      if( symlinkat( linkname, dirfd, name ) != 0 )
         {
-        if( format_error( rbuf, errno, cantln_msg, hard ? "" : "sym",
-                          linkname, filename ) &&
+        if( format_error( rbuf, errno, cantln_msg, "sym", linkname,
+                          filename ) &&
             !courier.collect_packet( member_id, worker_id, rbuf(), Packet::diag ) )
           return Trival( other_msg, 0, 1 );
         set_error_status( 1 );
         }
       } break;
     case tf_directory:
-      if( !exists && mkdir( filename, mode ) != 0 && errno != EEXIST )
+      // create dir writable by the owner; set its mode at the end
+      if( !dir_registry.make_dir( dirfd, name, filename, mode | S_IRWXU,
+                                  dir_made ) )
         {
         if( format_file_error( rbuf, filename, mkdir_msg, errno ) &&
             !courier.collect_packet( member_id, worker_id, rbuf(), Packet::diag ) )
@@ -415,7 +607,7 @@ Trival extract_member_lz( const Cl_options & cl_opts,
         makedev( parse_octal( header + devmajor_o, devmajor_l ),
                  parse_octal( header + devminor_o, devminor_l ) );
       const int dmode = ( typeflag == tf_chardev ? S_IFCHR : S_IFBLK ) | mode;
-      if( mknod( filename, dmode, dev ) != 0 )
+      if( mknodat( dirfd, name, dmode, dev ) != 0 )
         {
         if( format_file_error( rbuf, filename, mknod_msg, errno ) &&
             !courier.collect_packet( member_id, worker_id, rbuf(), Packet::diag ) )
@@ -425,7 +617,7 @@ Trival extract_member_lz( const Cl_options & cl_opts,
       break;
       }
     case tf_fifo:
-      if( mkfifo( filename, mode ) != 0 )
+      if( mkfifoat( dirfd, name, mode ) != 0 )
         {
         if( format_file_error( rbuf, filename, mkfifo_msg, errno ) &&
             !courier.collect_packet( member_id, worker_id, rbuf(), Packet::diag ) )
@@ -446,7 +638,10 @@ Trival extract_member_lz( const Cl_options & cl_opts,
   errno = 0;
   if( !islink &&
       ( !uid_gid_in_range( extended.get_uid(), extended.get_gid() ) ||
-        chown( filename, extended.get_uid(), extended.get_gid() ) != 0 ) )
+        ( ( outfd >= 0 ) ?
+          fchown( outfd, extended.get_uid(), extended.get_gid() ) :
+          fchownat( dirfd, name, extended.get_uid(), extended.get_gid(), 0 ) )
+        != 0 ) )
     {
     if( outfd >= 0 ) mode &= ~( S_ISUID | S_ISGID | S_ISVTX );
     // chown in many cases returns with EPERM, which can be safely ignored.
@@ -479,7 +674,7 @@ Trival extract_member_lz( const Cl_options & cl_opts,
           if( cl_opts.keep_damaged )
             { writeblock( outfd, buf, std::min( rest, (long long)ar.e_size() ) );
               close( outfd ); }
-          else { close( outfd ); unlink( filename ); }
+          else { close( outfd ); unlinkat( dirfd, name, 0 ); }
           }
         return Trival( ar.e_msg(), ar.e_code(), ret );
         }
@@ -493,12 +688,19 @@ Trival extract_member_lz( const Cl_options & cl_opts,
   if( outfd >= 0 && close( outfd ) != 0 )
       { format_file_error( rbuf, filename, eclosf_msg, errno );
         return Trival( rbuf(), 0, 1 ); }
-  if( !islink )
+  if( typeflag == tf_directory )		// defer until all files extracted
     {
-    struct utimbuf t;
-    t.actime = extended.atime().sec();
-    t.modtime = extended.mtime().sec();
-    utime( filename, &t );			// ignore errors
+    Dir_metadata md;
+    md.name = extended.path(); md.atime = extended.atime().sec();
+    md.mtime = extended.mtime().sec(); md.mode = mode; md.chmod = dir_made;
+    dir_metadata.push_back( md );
+    }
+  else if( !islink )
+    {
+    struct timespec ts[2];
+    ts[0].tv_sec = extended.atime().sec(); ts[0].tv_nsec = 0;
+    ts[1].tv_sec = extended.mtime().sec(); ts[1].tv_nsec = 0;
+    utimensat( dirfd, name, ts, 0 );		// ignore errors
     }
   if( ar.at_member_end() &&
       !courier.collect_packet( member_id, worker_id, "", Packet::member_done ) )
@@ -507,13 +709,71 @@ Trival extract_member_lz( const Cl_options & cl_opts,
   }
 
 
+bool lower_member( const Hard_link & hl1, const Hard_link & hl2 )
+  { return hl1.member_id < hl2.member_id ||
+           ( hl1.member_id == hl2.member_id && hl1.index < hl2.index ); }
+
+// return true if the name of 'hl' was extracted by a later tar member
+bool replaced( const std::vector< Name_record > & name_records,
+               const Hard_link & hl )
+  {
+  Name_record nr;
+  nr.crc = crc32c.compute_crc( (const uint8_t *)hl.filename.c_str(),
+                               hl.filename.size() );
+  std::vector< Name_record >::const_iterator it =
+    std::lower_bound( name_records.begin(), name_records.end(), nr );
+  for( ; it != name_records.end() && it->crc == nr.crc; ++it )
+    if( it->member_id > hl.member_id ||
+        ( it->member_id == hl.member_id && it->index > hl.index ) )
+      return true;
+  return false;
+  }
+
+/* Create hard links in archive order, replacing the files extracted by
+   previous tar members, as the serial decoder does. */
+void create_hard_links( std::vector< std::vector< Hard_link > > & hard_links,
+                        std::vector< std::vector< Name_record > > & records )
+  {
+  std::vector< Hard_link > & v = hard_links[0];
+  for( unsigned i = 1; i < hard_links.size(); ++i )
+    v.insert( v.end(), hard_links[i].begin(), hard_links[i].end() );
+  if( v.empty() ) return;
+  std::sort( v.begin(), v.end(), lower_member );
+  std::vector< Name_record > & nrv = records[0];
+  for( unsigned i = 1; i < records.size(); ++i )
+    nrv.insert( nrv.end(), records[i].begin(), records[i].end() );
+  std::sort( nrv.begin(), nrv.end() );
+  for( unsigned i = 0; i < v.size(); ++i )
+    {
+    const char * const linkname = v[i].linkname.c_str();
+    const char * const filename = v[i].filename.c_str();
+    struct stat st;
+    if( lstat( filename, &st ) == 0 )
+      {
+      if( replaced( nrv, v[i] ) ) continue;
+      if( S_ISDIR( st.st_mode ) ) rmdir( filename ); else unlink( filename );
+      }
+    if( linkat( AT_FDCWD, linkname, AT_FDCWD, filename, 0 ) != 0 )
+      { print_error( errno, cantln_msg, "", linkname, filename );
+        set_error_status( 1 ); }
+    }
+  }
+
+
 struct Worker_arg
   {
   const Cl_options * cl_opts;
   const Archive_descriptor * ad;
   Packet_courier * courier;
   Name_monitor * name_monitor;
+  Dir_registry * dir_registry;
   Cl_names * cl_names;
+  const std::vector< long > * members;	// lzip members to be decoded
+  const std::vector< Block > * tar_blocks;	// blocks if uncompressed
+  std::vector< Dir_metadata > * dir_metadata;	// dirs extracted by worker
+  std::vector< Hard_link > * hard_links;	// links extracted by worker
+  std::vector< Name_record > * name_records;	// names extracted by worker
+  int dir_cache_size;
   int worker_id;
   int num_workers;
   };
@@ -530,29 +790,43 @@ extern "C" void * dworker( void * arg )
   Packet_courier & courier = *tmp.courier;
   Name_monitor & name_monitor = *tmp.name_monitor;
   Cl_names & cl_names = *tmp.cl_names;
+  const std::vector< long > & members = *tmp.members;
+  const std::vector< Block > * const tar_blocks = tmp.tar_blocks;
+  std::vector< Dir_metadata > & dir_metadata = *tmp.dir_metadata;
+  std::vector< Hard_link > & hard_links = *tmp.hard_links;
+  std::vector< Name_record > & name_records = *tmp.name_records;
   const int worker_id = tmp.worker_id;
   const int num_workers = tmp.num_workers;
+  const long long udata_size =
+    tar_blocks ? tar_blocks->back().end() : ad.lzip_index.udata_size();
 
   bool master = false;
   Resizable_buffer rbuf;
+  Dir_registry & dir_registry = *tmp.dir_registry;
+  Dir_cache dir_cache( dir_registry, tmp.dir_cache_size );
   Archive_reader_i ar( ad );			// 1 of N parallel readers
   if( !rbuf.size() || ar.fatal() )
     { if( courier.request_mastership( worker_id, worker_id ) )
         courier.collect_packet( worker_id, worker_id, mem_msg, Packet::error1 );
       goto done; }
 
-  for( long i = worker_id; !master && i < ad.lzip_index.members(); i += num_workers )
+  for( unsigned long k = worker_id; !master && k < members.size();
+       k += num_workers )
     {
-    if( ad.lzip_index.dblock( i ).size() <= 0 )		// empty lzip member
+    const long i = members[k];
+    const Block & dblock =
+      tar_blocks ? (*tar_blocks)[i] : ad.lzip_index.dblock( i );
+    if( dblock.size() <= 0 )				// empty lzip member
       {
       if( courier.collect_packet( i, worker_id, "", Packet::member_done ) )
         continue; else break;
       }
 
-    long long data_end = ad.lzip_index.dblock( i ).end();
+    long long data_end = dblock.end();
     Extended extended;			// metadata from extended records
     bool prev_extended = false;		// prev header was extended
-    ar.set_member( i );			// prepare for new member
+    if( tar_blocks ) ar.set_block( dblock );	// prepare for new block
+    else ar.set_member( i );			// prepare for new member
     while( true )			// process one tar header per iteration
       {
       if( ar.data_pos() >= data_end )	// dblock.end or udata_size
@@ -561,10 +835,10 @@ extern "C" void * dworker( void * arg )
         // member end exceeded or ends in extended, process rest of file
         if( !courier.request_mastership( i, worker_id ) ) goto done;
         master = true;
-        if( data_end >= ad.lzip_index.udata_size() )
+        if( data_end >= udata_size )
           { courier.collect_packet( i, worker_id, end_msg, Packet::error2 );
             goto done; }
-        data_end = ad.lzip_index.udata_size();
+        data_end = udata_size;
         if( ar.data_pos() == data_end && !prev_extended ) break;
         }
       Tar_header header;
@@ -656,7 +930,9 @@ extern "C" void * dworker( void * arg )
           trival = compare_member_lz( cl_opts, ar, courier, extended, header,
                                       rbuf, i, worker_id );
         else trival = extract_member_lz( cl_opts, ar, courier, extended, header,
-                                         rbuf, i, worker_id, name_monitor );
+                                         rbuf, i, worker_id, name_monitor,
+                                         dir_registry, dir_cache, dir_metadata,
+                                         hard_links, name_records );
         }
       if( trival.retval )				// fatal error
 fatal:  { if( courier.request_mastership( i, worker_id ) )
@@ -710,18 +986,108 @@ int muxer( const char * const archive_namep, Packet_courier & courier )
 } // end namespace
 
 
+/* Scan the headers of an uncompressed seekable archive, skipping file data,
+   and divide it into blocks of whole tar members that can be decoded in
+   parallel. Return false if the archive is not a valid tar archive ending
+   in EOA blocks, leaving any diagnostics to the serial decoder.
+*/
+bool index_tar( const Cl_options & cl_opts, const Archive_descriptor & ad,
+                std::vector< Block > & tar_blocks )
+  {
+  const long long block_size = 1 << 20;		// minimum size of a block
+  const long long file_size = ad.lzip_index.file_size();
+  if( !ad.seekable || ad.indexed || file_size <= 3 * header_size )
+    return false;
+  Resizable_buffer rbuf;
+  Archive_reader_i ar( ad );
+  if( !rbuf.size() || ar.fatal() ) return false;
+  ar.set_block( Block( 0, file_size ) );
+  Extended extended;			// metadata from extended records
+  bool prev_extended = false;		// prev header was extended
+  long long block_pos = 0;
+  tar_blocks.clear();
+  while( true )				// process one tar header per iteration
+    {
+    if( !prev_extended && ar.data_pos() - block_pos >= block_size )
+      { tar_blocks.push_back( Block( block_pos, ar.data_pos() - block_pos ) );
+        block_pos = ar.data_pos(); }
+    Tar_header header;
+    if( ar.read( header, header_size ) != 0 ) return false;
+    if( !check_ustar_chksum( header ) )		// error or EOA
+      {
+      if( !block_is_zero( header, header_size ) ||
+          ( prev_extended && !cl_opts.permissive ) ) return false;
+      tar_blocks.push_back( Block( block_pos, file_size - block_pos ) );
+      return true;
+      }
+    const Typeflag typeflag = (Typeflag)header[typeflag_o];
+    std::vector< std::string > msg_vec;		// ignored
+    if( typeflag == tf_global )
+      {
+      Extended dummy;		// global headers are parsed and ignored
+      if( ( prev_extended && !cl_opts.permissive ) ||
+          ar.parse_records( dummy, header, rbuf, gblrec_msg, true,
+                            &msg_vec ) != 0 ) return false;
+      continue;
+      }
+    if( typeflag == tf_extended )
+      {
+      if( ( prev_extended && !cl_opts.permissive ) ||
+          ar.parse_records( extended, header, rbuf, extrec_msg,
+                            cl_opts.permissive, &msg_vec ) != 0 ||
+          ( !extended.crc_present() && cl_opts.missing_crc ) ) return false;
+      prev_extended = true; continue;
+      }
+    prev_extended = false;
+    extended.fill_from_ustar( header );	// copy metadata from header
+    if( ar.skip_member( extended ) != 0 ) return false;
+    extended.reset();
+    }
+  }
+
+
 // init the courier, then start the workers and call the muxer.
 int decode_lz( const Cl_options & cl_opts, const Archive_descriptor & ad,
-               Cl_names & cl_names )
+               Cl_names & cl_names, const int catalog_fd,
+               const std::vector< Block > * const tar_blocks )
   {
   const int out_slots = 65536;		// max small files (<=512B) in 64 MiB
+  std::vector< long > members;		// lzip members to be decoded
+  if( tar_blocks )
+    {
+    for( unsigned long i = 0; i < tar_blocks->size(); ++i )
+      members.push_back( i );
+    if( cl_opts.debug_level & 1 )
+      std::fprintf( stderr, "uncompressed archive divided in %lu blocks\n",
+                    tar_blocks->size() );
+    }
+  else if( catalog_fd >= 0 &&
+      read_catalog( catalog_fd, cl_opts.catalog_name.c_str(), ad.lzip_index,
+                    cl_names, cl_opts.recursive, members ) )
+    {
+    if( cl_opts.debug_level & 1 )
+      std::fprintf( stderr, "catalog selected %lu of %ld lzip members\n",
+                    members.size(), ad.lzip_index.members() );
+    }
+  else
+    for( long i = 0; i < ad.lzip_index.members(); ++i ) members.push_back( i );
   const int num_workers =		// limited to number of members
-    std::min( (long)cl_opts.num_workers, ad.lzip_index.members() );
+    std::min( (long)cl_opts.num_workers, (long)members.size() );
   if( cl_opts.program_mode == m_extract ) get_umask();	// cache the umask
   Name_monitor
     name_monitor( ( cl_opts.program_mode == m_extract ) ? num_workers : 0 );
+  Dir_registry dir_registry;
 
   Packet_courier courier( num_workers, out_slots );
+  std::vector< std::vector< Dir_metadata > > dir_metadata( num_workers );
+  std::vector< std::vector< Hard_link > > hard_links( num_workers );
+  std::vector< std::vector< Name_record > > name_records( num_workers );
+  // share the free file descriptors among the workers, one for each outfd
+  int dir_cache_size = Dir_cache::max_size;
+  struct rlimit rl;			// leave 16 fds for stdio, archive, etc
+  if( getrlimit( RLIMIT_NOFILE, &rl ) == 0 && rl.rlim_cur < 1 << 20 )
+    dir_cache_size = std::min( (long)dir_cache_size,
+      std::max( 0L, ( (long)rl.rlim_cur - 16 ) / num_workers - 1 ) );
 
   Worker_arg * worker_args = new( std::nothrow ) Worker_arg[num_workers];
   pthread_t * worker_threads = new( std::nothrow ) pthread_t[num_workers];
@@ -732,7 +1098,14 @@ int decode_lz( const Cl_options & cl_opts, const Archive_descriptor & ad,
     worker_args[i].ad = &ad;
     worker_args[i].courier = &courier;
     worker_args[i].name_monitor = &name_monitor;
+    worker_args[i].dir_registry = &dir_registry;
     worker_args[i].cl_names = &cl_names;
+    worker_args[i].members = &members;
+    worker_args[i].tar_blocks = tar_blocks;
+    worker_args[i].dir_metadata = &dir_metadata[i];
+    worker_args[i].hard_links = &hard_links[i];
+    worker_args[i].name_records = &name_records[i];
+    worker_args[i].dir_cache_size = dir_cache_size;
     worker_args[i].worker_id = i;
     worker_args[i].num_workers = num_workers;
     const int errcode =
@@ -751,6 +1124,14 @@ int decode_lz( const Cl_options & cl_opts, const Archive_descriptor & ad,
     }
   delete[] worker_threads;
   delete[] worker_args;
+  if( cl_opts.program_mode == m_extract )
+    {
+    create_hard_links( hard_links, name_records );
+    std::vector< Dir_metadata > & v = dir_metadata[0];
+    for( int i = 1; i < num_workers; ++i )
+      v.insert( v.end(), dir_metadata[i].begin(), dir_metadata[i].end() );
+    set_dir_metadata( v, AT_FDCWD );
+    }
 
   if( close( ad.infd ) != 0 )
     { show_file_error( ad.namep, eclosa_msg, errno ); set_retval( retval, 1 ); }
@@ -759,11 +1140,17 @@ int decode_lz( const Cl_options & cl_opts, const Archive_descriptor & ad,
     set_error_status( 1 );
 
   if( cl_opts.debug_level & 1 )
+    {
     std::fprintf( stderr,
       "muxer tried to consume from workers       %8u times\n"
       "muxer had to wait                         %8u times\n",
       courier.ocheck_counter,
       courier.owait_counter );
+    if( cl_opts.program_mode == m_extract )
+      std::fprintf( stderr,
+        "any worker had to wait for name monitor   %8u times\n",
+        name_monitor.wait_counter() );
+    }
 
   if( !courier.finished() ) internal_error( conofin_msg );
   return final_exit_status( retval, cl_opts.program_mode != m_diff );
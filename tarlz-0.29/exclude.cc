@@ -17,35 +17,159 @@
 
 #define _FILE_OFFSET_BITS 64
 
+#include <algorithm>
+#include <cstring>
 #include <fnmatch.h>
 
 #include "tarlz.h"
 
 
+namespace {
+
+// sorted set of strings that can be searched without building a string
+struct Literal_set
+  {
+  std::vector< std::string > strings;		// sorted, without duplicates
+  std::vector< unsigned > sizes;		// sizes of strings, sorted
+
+  bool empty() const { return strings.empty(); }
+  void insert( const std::string & s );
+  bool contains( const char * const s, const unsigned size ) const;
+  };
+
+
+void Literal_set::insert( const std::string & s )
+  {
+  std::vector< std::string >::iterator it =
+    std::lower_bound( strings.begin(), strings.end(), s );
+  if( it != strings.end() && *it == s ) return;
+  strings.insert( it, s );
+  std::vector< unsigned >::iterator it2 =
+    std::lower_bound( sizes.begin(), sizes.end(), s.size() );
+  if( it2 == sizes.end() || *it2 != s.size() ) sizes.insert( it2, s.size() );
+  }
+
+
+bool Literal_set::contains( const char * const s, const unsigned size ) const
+  {
+  unsigned l = 0, r = strings.size();
+  while( l < r )				// binary search
+    {
+    const unsigned m = l + ( r - l ) / 2;
+    const std::string & str = strings[m];
+    const unsigned ssize = str.size();
+    int diff = std::memcmp( str.data(), s, std::min( ssize, size ) );
+    if( diff == 0 && ssize != size ) diff = ( ssize < size ) ? -1 : 1;
+    if( diff == 0 ) return true;
+    if( diff < 0 ) l = m + 1; else r = m;
+    }
+  return false;
+  }
+
+
+inline bool is_meta( const char ch )
+  { return ch == '*' || ch == '?' || ch == '[' || ch == '\\'; }
+
+bool has_meta( const char * const s, const unsigned size )
+  {
+  for( unsigned i = 0; i < size; ++i ) if( is_meta( s[i] ) ) return true;
+  return false;
+  }
+
+} // end namespace
+
+
+/* Patterns are classified when added so that 'excluded' tests each one only
+   where it can match:
+   Literal patterns match a sequence of components ending at a component
+   boundary. Patterns of the form 'literal*' match a sequence of components
+   starting with 'literal'. Patterns of the form '*literal' match if the
+   filename up to a component boundary ends with 'literal'. These three are
+   matched by searching in a Literal_set at each component (boundary).
+   Other patterns starting with '*' match at some component if and only if
+   they match the whole filename, so fnmatch is called just once for them.
+   The rest of the patterns are indexed by their first character. */
 namespace Exclude {
 
-std::vector< std::string > patterns;		// list of patterns
+Literal_set literals;		// patterns without metacharacters
+Literal_set prefixes;		// patterns of the form 'literal*'
+Literal_set suffixes;		// patterns of the form '*literal'
+std::vector< std::string > star_globs;		// other patterns starting with '*'
+std::vector< std::string > any_globs;		// patterns starting with [?[\\]
+std::vector< std::string > globs[256];		// indexed by first character
+bool empty = true;
 
 } // end namespace Exclude
 
 
 void Exclude::add_pattern( const std::string & arg )
-  { patterns.push_back( arg ); }
+  {
+  empty = false;
+  const unsigned size = arg.size();
+  if( size > 0 && !has_meta( arg.data(), size ) ) literals.insert( arg );
+  else if( size > 1 && arg[size-1] == '*' && !has_meta( arg.data(), size - 1 ) )
+    prefixes.insert( arg.substr( 0, size - 1 ) );
+  else if( size > 1 && arg[0] == '*' && !has_meta( arg.data() + 1, size - 1 ) )
+    suffixes.insert( arg.substr( 1 ) );
+  else if( size > 0 && arg[0] == '*' ) star_globs.push_back( arg );
+  else if( size == 0 || is_meta( arg[0] ) ) any_globs.push_back( arg );
+  else globs[(unsigned char)arg[0]].push_back( arg );
+  }
 
 
-bool Exclude::excluded( const char * const filename )
+namespace {
+
+bool match_globs( const std::vector< std::string > & patterns,
+                  const char * const p )
   {
-  if( patterns.empty() ) return false;
-  const char * p = filename;
-  do {
-    for( unsigned i = 0; i < patterns.size(); ++i )
-      // ignore a trailing sequence starting with '/' in filename
+  for( unsigned i = 0; i < patterns.size(); ++i )
+    // ignore a trailing sequence starting with '/' in filename
 #ifdef FNM_LEADING_DIR
-      if( fnmatch( patterns[i].c_str(), p, FNM_LEADING_DIR ) == 0 ) return true;
+    if( fnmatch( patterns[i].c_str(), p, FNM_LEADING_DIR ) == 0 ) return true;
 #else
-      if( fnmatch( patterns[i].c_str(), p, 0 ) == 0 ||
-          fnmatch( ( patterns[i] + "/*" ).c_str(), p, 0 ) == 0 ) return true;
+    if( fnmatch( patterns[i].c_str(), p, 0 ) == 0 ||
+        fnmatch( ( patterns[i] + "/*" ).c_str(), p, 0 ) == 0 ) return true;
 #endif
+  return false;
+  }
+
+} // end namespace
+
+
+bool Exclude::excluded( const char * const filename )
+  {
+  if( empty ) return false;
+  const unsigned len = std::strlen( filename );
+  if( !suffixes.empty() )		// test filename up to each boundary
+    for( unsigned k = 1; k <= len; ++k )
+      {
+      if( k < len && filename[k] != '/' ) continue;
+      for( unsigned i = 0; i < suffixes.sizes.size(); ++i )
+        {
+        const unsigned size = suffixes.sizes[i];
+        if( size > k ) break;
+        if( suffixes.contains( filename + k - size, size ) ) return true;
+        }
+      }
+  if( match_globs( star_globs, filename ) ) return true;
+  const char * p = filename;
+  do {
+    const unsigned rest = len - ( p - filename );
+    for( unsigned i = 0; i < literals.sizes.size(); ++i )
+      {
+      const unsigned size = literals.sizes[i];
+      if( size > rest ) break;
+      if( ( p[size] == 0 || p[size] == '/' ) && literals.contains( p, size ) )
+        return true;
+      }
+    for( unsigned i = 0; i < prefixes.sizes.size(); ++i )
+      {
+      const unsigned size = prefixes.sizes[i];
+      if( size > rest ) break;
+      if( prefixes.contains( p, size ) ) return true;
+      }
+    if( match_globs( globs[(unsigned char)*p], p ) ||
+        match_globs( any_globs, p ) ) return true;
     while( *p && *p != '/' ) ++p;		// skip component
     while( *p == '/' ) ++p;			// skip slashes
     } while( *p );
@@ -125,8 +125,12 @@ void show_help( const long num_online )
     "        --owner=<owner>       use <owner> name/ID for files added to archive\n"
     "        --group=<group>       use <group> name/ID for files added to archive\n"
     "        --numeric-owner       don't write owner or group names to archive\n"
+    "      --catalog=<file>        write/use catalog of archive members in <file>\n"
+    "      --dedup                 archive files with identical contents as links\n"
     "      --depth                 archive entries before the directory itself\n"
     "      --exclude=<pattern>     exclude files matching a shell pattern\n"
+    "      --hard-links            archive hard links as link members\n"
+    "      --ignore-contents       compare only metadata, not file contents\n"
     "      --ignore-ids            ignore differences in owner and group IDs\n"
     "      --ignore-metadata       compare only file size and file content\n"
     "      --ignore-overflow       ignore mtime overflow differences on 32-bit\n"
@@ -528,6 +532,22 @@ int open_outstream( const std::string & name, const bool create,
   }
 
 
+/* Create file 'name' in directory dirfd, failing if it exists.
+   Use 'filename' (the full name) in error messages. */
+int open_outstream_at( const int dirfd, const char * const name,
+                       const char * const filename, Resizable_buffer & rbuf )
+  {
+  const int flags = O_CREAT | O_WRONLY | O_EXCL | O_BINARY;
+  const mode_t outfd_mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+
+  const int outfd = openat( dirfd, name, flags, outfd_mode );
+  if( outfd < 0 )
+    format_file_error( rbuf, filename, ( errno == EEXIST ) ?
+                       "Skipping file" : "Can't create file", errno );
+  return outfd;
+  }
+
+
 void show_error( const char * const msg, const int errcode, const bool help )
   {
   if( verbosity < 0 ) return;
@@ -648,10 +668,11 @@ int main( const int argc, const char * const argv[] )
   {
   if( argc > 0 ) invocation_name = argv[0];
 
-  enum { opt_ano = 256, opt_aso, opt_bso, opt_chk, opt_crc, opt_dbg, opt_del,
-         opt_dep, opt_dso, opt_exc, opt_grp, opt_iid, opt_imd, opt_kd,
-         opt_mnt, opt_mti, opt_nso, opt_num, opt_ofl, opt_out, opt_own,
-         opt_par, opt_per, opt_rec, opt_sol, opt_tb, opt_un, opt_wn, opt_xdv };
+  enum { opt_ano = 256, opt_aso, opt_bso, opt_cat, opt_chk, opt_crc, opt_dbg,
+         opt_ddp, opt_del, opt_dep, opt_dso, opt_exc, opt_grp, opt_hl, opt_ico,
+         opt_iid, opt_imd, opt_kd, opt_mnt, opt_mti, opt_nso, opt_num, opt_ofl,
+         opt_out, opt_own, opt_par, opt_per, opt_rec, opt_sol, opt_tb, opt_un,
+         opt_wn, opt_xdv };
   const Arg_parser::Option options[] =
     {
     { '0', 0,                      Arg_parser::no  },
@@ -688,13 +709,17 @@ int main( const int argc, const char * const argv[] )
     { opt_ano, "anonymous",        Arg_parser::no  },
     { opt_aso, "asolid",           Arg_parser::no  },
     { opt_bso, "bsolid",           Arg_parser::no  },
+    { opt_cat, "catalog",          Arg_parser::yes },
     { opt_chk, "check-lib",        Arg_parser::no  },
     { opt_dbg, "debug",            Arg_parser::yes },
+    { opt_ddp, "dedup",            Arg_parser::no  },
     { opt_del, "delete",           Arg_parser::no  },
     { opt_dep, "depth",            Arg_parser::no  },
     { opt_dso, "dsolid",           Arg_parser::no  },
     { opt_exc, "exclude",          Arg_parser::yes },
     { opt_grp, "group",            Arg_parser::yes },
+    { opt_hl,  "hard-links",       Arg_parser::no  },
+    { opt_ico, "ignore-contents",  Arg_parser::no  },
     { opt_iid, "ignore-ids",       Arg_parser::no  },
     { opt_imd, "ignore-metadata",  Arg_parser::no  },
     { opt_kd,  "keep-damaged",     Arg_parser::no  },
@@ -774,14 +799,18 @@ int main( const int argc, const char * const argv[] )
                     cl_opts.gid = parse_group( "root", pn ); break;
       case opt_aso: cl_opts.solidity = asolid; break;
       case opt_bso: cl_opts.solidity = bsolid; break;
+      case opt_cat: cl_opts.catalog_name = sarg; break;
       case opt_crc: cl_opts.missing_crc = true; break;
       case opt_chk: return check_lib();
       case opt_dbg: cl_opts.debug_level = getnum( arg, pn, 0, 3 ); break;
+      case opt_ddp: cl_opts.dedup = cl_opts.hard_links = true; break;
       case opt_del: set_mode( cl_opts.program_mode, m_delete ); break;
       case opt_dep: cl_opts.depth = true; break;
       case opt_dso: cl_opts.solidity = dsolid; break;
       case opt_exc: Exclude::add_pattern( sarg ); break;
       case opt_grp: cl_opts.gid = parse_group( arg, pn ); break;
+      case opt_hl:  cl_opts.hard_links = true; break;
+      case opt_ico: cl_opts.ignore_contents = true; break;
       case opt_iid: cl_opts.ignore_ids = true; break;
       case opt_imd: cl_opts.ignore_metadata = true; break;
       case opt_kd:  cl_opts.keep_damaged = true; break;
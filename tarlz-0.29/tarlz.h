@@ -422,6 +422,7 @@ struct Cl_options		// command-line options
   {
   const Arg_parser & parser;
   std::string archive_name;
+  std::string catalog_name;
   std::string output_filename;
   long long mtime;
   long long uid;
@@ -435,7 +436,10 @@ struct Cl_options		// command-line options
   int num_workers;		// start this many worker threads
   int out_slots;
   bool depth;
+  bool dedup;			// archive identical files as hard links
   bool dereference;
+  bool hard_links;		// archive hard links as link members
+  bool ignore_contents;
   bool ignore_ids;
   bool ignore_metadata;
   bool ignore_overflow;
@@ -458,7 +462,8 @@ struct Cl_options		// command-line options
     : parser( ap ), mtime( 0 ), uid( -1 ), gid( -1 ), program_mode( m_none ),
       solidity( bsolid ), data_size( 0 ), debug_level( 0 ), level( 6 ),
       num_files( 0 ), num_workers( -1 ), out_slots( 64 ), depth( false ),
-      dereference( false ), ignore_ids( false ), ignore_metadata( false ),
+      dedup( false ), dereference( false ), hard_links( false ),
+      ignore_contents( false ), ignore_ids( false ), ignore_metadata( false ),
       ignore_overflow( false ), keep_damaged( false ), level_set( false ),
       missing_crc( false ), mount( false ), mtime_set( false ),
       numeric_owner( false ), option_C_present( false ),
@@ -510,7 +515,8 @@ int writeblock( const int fd, const uint8_t * const buf, const int size );
 
 // defined in common_decode.cc
 bool block_is_zero( const uint8_t * const buf, const int size );
-bool make_dirs( const std::string & name );
+bool make_dirs( const std::string & name,
+                std::vector< std::string > * const created = 0 );
 
 // defined in common_mutex.cc
 void exit_fail_mt( const int retval = 1 );	// terminate the program
@@ -582,6 +588,8 @@ const char * format_num3( unsigned long long num, const bool negative = false );
 int open_instream( const char * const name, struct stat * const in_statsp = 0 );
 int open_outstream( const std::string & name, const bool create = true,
                     Resizable_buffer * const rbufp = 0, const bool force = true );
+int open_outstream_at( const int dirfd, const char * const name,
+                       const char * const filename, Resizable_buffer & rbuf );
 void show_error( const char * const msg, const int errcode = 0,
                  const bool help = false );
 bool format_error( Resizable_buffer & rbuf, const int errcode,